@@ -0,0 +1,107 @@
+#ifndef CPP_AST_H
+#define CPP_AST_H
+
+#include <vector>
+#include "nfa.h"
+
+/**
+ * 抽象语法树结点的类型，与regex.g4中的regex、expression、expressionItem一一对应
+ */
+enum NodeType {
+    NODE_ALTERNATION, // 多个分支的选择，子结点都是NODE_CONCAT
+    NODE_CONCAT, // 依次连接，子结点都是NODE_SET、NODE_GROUP或NODE_ANCHOR
+    NODE_SET, // 单个字符、字符类或字符组，value为RegexAST::sets中的下标
+    NODE_GROUP, // 分组，唯一的子结点是NODE_ALTERNATION，value为捕获分组的编号k（第k+1个分组），-1表示非捕获
+    NODE_ANCHOR, // anchor，value为AnchorFlag
+};
+
+/**
+ * NODE_SET与NODE_GROUP上的量词
+ */
+enum QuantifierType {
+    QUANT_NONE,
+    QUANT_ZERO_OR_ONE, // ?
+    QUANT_ZERO_OR_MORE, // *
+    QUANT_ONE_OR_MORE, // +
+    QUANT_RANGE, // {m} {m,} {m,n}，范围为[min, max]，max为-1表示无界
+};
+
+struct RegexNode {
+    NodeType type;
+    int value = -1; // 含义见NodeType
+    QuantifierType quantifier = QUANT_NONE;
+    bool lazy = false; // 量词后是否有?
+    int min = 1, max = 1; // QUANT_RANGE的范围
+    int child = -1; // 第一个子结点，-1表示没有
+    int last_child = -1; // 最后一个子结点，用于O(1)地追加
+    int next = -1; // 下一个兄弟结点，-1表示没有
+
+    bool operator==(const RegexNode &other) const
+    {
+        return type == other.type && value == other.value && quantifier == other.quantifier && lazy == other.lazy
+            && min == other.min && max == other.max && child == other.child && last_child == other.last_child && next == other.next;
+    }
+};
+
+/**
+ * 正则表达式的抽象语法树。所有结点保存在一个数组中，用下标互相引用，子结点按从左到右的顺序串成链表，
+ * 比ANTLR的语法分析树紧凑得多，语法分析树释放之后，NFA的构造（见NFABuilder）与字面量分析（见LiteralInfo::analyze）都在它上面进行。
+ * 树的深度可以很大（数千层嵌套的括号），因此所有遍历都使用显式的栈，不使用递归。
+ */
+class RegexAST {
+public:
+    std::vector<RegexNode> nodes;
+    std::vector<ByteSet> sets; // NODE_SET能匹配的字节集合
+    int root = -1; // 根结点，为NODE_ALTERNATION
+    int group_num = 0; // 捕获分组的个数
+
+    /**
+     * 新增一个没有子结点的结点，返回它的下标
+     */
+    int addNode(NodeType type, int value = -1)
+    {
+        nodes.emplace_back();
+        nodes.back().type = type;
+        nodes.back().value = value;
+        return nodes.size() - 1;
+    }
+
+    /**
+     * 把child追加为parent的最后一个子结点
+     */
+    void addChild(int parent, int child)
+    {
+        RegexNode &p = nodes[parent];
+        if(p.last_child < 0)
+            p.child = child;
+        else
+            nodes[p.last_child].next = child;
+        p.last_child = child;
+    }
+
+    bool operator==(const RegexAST &other) const
+    {
+        return nodes == other.nodes && sets == other.sets && root == other.root && group_num == other.group_num;
+    }
+
+    /**
+     * 所有结点的后序序列：子结点都排在父结点之前，兄弟结点从左到右
+     */
+    std::vector<int> postorder() const
+    {
+        // 先按“父结点、子结点从右到左”的顺序出栈，得到的序列反过来就是后序
+        std::vector<int> order, stack{root};
+        order.reserve(nodes.size());
+        while(!stack.empty())
+        {
+            int n = stack.back();
+            stack.pop_back();
+            order.push_back(n);
+            for(int c = nodes[n].child; c >= 0; c = nodes[c].next)
+                stack.push_back(c);
+        }
+        return std::vector<int>(order.rbegin(), order.rend());
+    }
+};
+
+#endif //CPP_AST_H
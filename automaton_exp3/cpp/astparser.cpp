@@ -0,0 +1,314 @@
+#include "astparser.h"
+#include <cstring>
+#include <stdexcept>
+
+/**
+ * \d \w \s \D \W \S中反斜杠后面的字母
+*/
+static bool isClass(char c)
+{
+    return c != '\0' && strchr("wWdDsS", c) != nullptr;
+}
+
+static bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+RegexAST ASTParser::parse(const std::string &pattern, bool flag_s)
+{
+    ASTParser parser(pattern, flag_s);
+    parser.parseRegex();
+    return std::move(parser.ast);
+}
+
+char ASTParser::unescape(char c)
+{
+    if(c == 'f')
+        return '\f';
+    else if(c == 'n')
+        return '\n';
+    else if(c == 'r')
+        return '\r';
+    else if(c == 't')
+        return '\t';
+    else if(c == 'v')
+        return '\v';
+    return c;
+}
+
+void ASTParser::error(const std::string &message) const
+{
+    throw std::runtime_error("parser解析失败，位置" + std::to_string(pos) + "：" + message);
+}
+
+/**
+ * alternation和concat是当前所在的选择和分支；遇到'('时把它们压栈，进入分组内部的选择，遇到')'时弹出。
+ * 结点的创建顺序与Regex::buildAST相同：分组结点之后紧接着创建它内部的选择和第一个分支
+*/
+void ASTParser::parseRegex()
+{
+    struct Open {
+        int alternation, concat, group;
+    };
+    std::vector<Open> open; // 尚未闭合的分组
+
+    ast.root = ast.addNode(NODE_ALTERNATION);
+    int alternation = ast.root;
+    int concat = ast.addNode(NODE_CONCAT);
+    ast.addChild(alternation, concat);
+
+    while(true)
+    {
+        if(pos == pattern.size() || pattern[pos] == '|' || pattern[pos] == ')')
+        {
+            // expression : expressionItem+
+            if(ast.nodes[concat].child < 0)
+                error("缺少表达式");
+            if(pos == pattern.size())
+            {
+                if(!open.empty())
+                    error("缺少')'");
+                return;
+            }
+
+            if(pattern[pos] == '|')
+            {
+                pos++;
+                concat = ast.addNode(NODE_CONCAT);
+                ast.addChild(alternation, concat);
+                continue;
+            }
+
+            if(open.empty())
+                error("多余的')'");
+            pos++;
+            int group = open.back().group;
+            alternation = open.back().alternation;
+            concat = open.back().concat;
+            open.pop_back();
+            parseQuantifier(group);
+            continue;
+        }
+
+        if(pattern[pos] == '(')
+        {
+            pos++;
+            int value = -1;
+            if(pattern.compare(pos, 2, "?:") == 0)
+                pos += 2;
+            else
+                value = ast.group_num++;
+            int group = ast.addNode(NODE_GROUP, value);
+            ast.addChild(concat, group);
+            open.push_back({alternation, concat, group});
+
+            alternation = ast.addNode(NODE_ALTERNATION);
+            ast.addChild(group, alternation);
+            concat = ast.addNode(NODE_CONCAT);
+            ast.addChild(alternation, concat);
+            continue;
+        }
+
+        // anchor之后不能有量词：量词不能作为expressionItem的开头，下一轮在parseSingle中报错
+        int anchor = parseAnchor();
+        if(anchor)
+        {
+            ast.addChild(concat, ast.addNode(NODE_ANCHOR, anchor));
+            continue;
+        }
+
+        ast.sets.push_back(parseSingle());
+        int n = ast.addNode(NODE_SET, ast.sets.size() - 1);
+        ast.addChild(concat, n);
+        parseQuantifier(n);
+    }
+}
+
+int ASTParser::parseAnchor()
+{
+    char c = pattern[pos];
+    if(c == '^' || c == '$')
+    {
+        pos++;
+        return c == '^' ? ANCHOR_BEGIN : ANCHOR_END;
+    }
+    if(c == '\\' && pos + 1 < pattern.size() && (pattern[pos+1] == 'b' || pattern[pos+1] == 'B'))
+    {
+        pos += 2;
+        return pattern[pos-1] == 'b' ? ANCHOR_WORD : ANCHOR_NOT_WORD;
+    }
+    return 0;
+}
+
+/**
+ * 与ANTLR的词法分析一致：反斜杠后接数字或位于末尾时不构成转义字符，反斜杠本身是一个普通字符；
+ * ? * + { } ]只能出现在量词或字符组中，不能作为普通字符
+*/
+ByteSet ASTParser::parseSingle()
+{
+    ByteSet set;
+    char c = pattern[pos];
+    if(c == '.')
+    {
+        pos++;
+        return ByteSet::special('.', flag_s);
+    }
+    if(c == '[')
+    {
+        pos++;
+        return parseCharacterGroup();
+    }
+    if(c == '\\' && pos + 1 < pattern.size() && !isDigit(pattern[pos+1]))
+    {
+        char d = pattern[pos+1];
+        pos += 2;
+        if(isClass(d))
+            return ByteSet::special(d, flag_s);
+        set.set(unescape(d));
+        return set;
+    }
+    if(strchr("?*+{}]", c) != nullptr)
+        error(std::string("意外的'") + c + "'");
+    pos++;
+    set.set(c);
+    return set;
+}
+
+void ASTParser::parseQuantifier(int node)
+{
+    if(pos == pattern.size())
+        return;
+
+    QuantifierType quantifier;
+    int min = 1, max = 1;
+    char c = pattern[pos];
+    if(c == '?')
+        quantifier = QUANT_ZERO_OR_ONE;
+    else if(c == '*')
+        quantifier = QUANT_ZERO_OR_MORE;
+    else if(c == '+')
+        quantifier = QUANT_ONE_OR_MORE;
+    else if(c == '{')
+    {
+        // rangeQuantifier : '{' integer ','? integer? '}'
+        quantifier = QUANT_RANGE;
+        pos++;
+        min = max = parseInteger();
+        if(pos < pattern.size() && pattern[pos] == ',')
+        {
+            pos++;
+            max = pos < pattern.size() && isDigit(pattern[pos]) ? parseInteger() : -1;
+        }
+        if(pos == pattern.size() || pattern[pos] != '}')
+            error("量词缺少'}'");
+    }
+    else
+        return;
+    pos++;
+
+    RegexNode &n = ast.nodes[node];
+    n.quantifier = quantifier;
+    n.min = min;
+    n.max = max;
+    if(pos < pattern.size() && pattern[pos] == '?')
+    {
+        n.lazy = true;
+        pos++;
+    }
+}
+
+int ASTParser::parseInteger()
+{
+    if(pos == pattern.size() || !isDigit(pattern[pos]))
+        error("缺少整数");
+    long long value = 0;
+    while(pos < pattern.size() && isDigit(pattern[pos]))
+    {
+        value = value * 10 + (pattern[pos++] - '0');
+        if(value > 0x7fffffff)
+            error("整数过大");
+    }
+    return value;
+}
+
+ByteSet ASTParser::parseCharacterGroup()
+{
+    ByteSet set;
+    size_t p = pos;
+    if(p < pattern.size() && pattern[p] == '^')
+    {
+        size_t q = p + 1;
+        if(parseGroupItems(q, set))
+        {
+            set.invert();
+            pos = q;
+            return set;
+        }
+        set = ByteSet();
+    }
+    if(!parseGroupItems(p, set))
+        error("字符组解析失败");
+    pos = p;
+    return set;
+}
+
+bool ASTParser::parseGroupItems(size_t &p, ByteSet &set) const
+{
+    // characterGroup : '[' characterGroupNegativeModifier? characterGroupItem+ ']'
+    int count = 0;
+    while(p < pattern.size())
+    {
+        if(pattern[p] == ']')
+        {
+            p++;
+            return count > 0;
+        }
+        count++;
+
+        if(pattern[p] == '\\' && p + 1 < pattern.size() && isClass(pattern[p+1]))
+        {
+            set |= ByteSet::special(pattern[p+1], flag_s);
+            p += 2;
+            continue;
+        }
+
+        int lo = parseCharInGroup(p);
+        if(lo < 0)
+            return false;
+        if(p < pattern.size() && pattern[p] == '-')
+        {
+            // characterRange : charInGroup '-' charInGroup
+            p++;
+            int hi = parseCharInGroup(p);
+            if(hi < 0)
+                return false;
+            set.setRange(lo, hi);
+        }
+        else
+            set.set(lo);
+    }
+    return false;
+}
+
+/**
+ * 除了'-'和']'，字符组中的任何字符都是普通字符；\b \B在词法分析中是anchor，不能出现在字符组中
+*/
+int ASTParser::parseCharInGroup(size_t &p) const
+{
+    if(p >= pattern.size())
+        return -1;
+    char c = pattern[p];
+    if(c == '-' || c == ']')
+        return -1;
+    if(c == '\\' && p + 1 < pattern.size() && !isDigit(pattern[p+1]))
+    {
+        char d = pattern[p+1];
+        if(d == 'b' || d == 'B' || isClass(d))
+            return -1;
+        p += 2;
+        return (unsigned char)unescape(d);
+    }
+    p++;
+    return (unsigned char)c;
+}
@@ -0,0 +1,73 @@
+#ifndef CPP_ASTPARSER_H
+#define CPP_ASTPARSER_H
+
+#include <string>
+#include "ast.h"
+
+/**
+ * 手写的语法分析器，按regex.g4的文法直接把正则表达式解析为抽象语法树（见RegexAST），不依赖ANTLR。
+ * 按文法自顶向下地逐条展开（regex、expression、expressionItem……），唯一递归的产生式 group : '(' regex ')'
+ * 用一个显式的栈记录尚未闭合的分组，嵌套再深也不会耗尽调用栈。
+ * 对同一个pattern，得到的抽象语法树与由ANTLR的语法分析树转换得到的（见Regex::buildAST）完全相同，ANTLR报告语法错误的pattern同样报错。
+ */
+class ASTParser {
+public:
+    /**
+     * 解析pattern，有语法错误时抛出std::runtime_error
+     * @param flag_s 是否有s修饰符（决定.能匹配的字节）
+     */
+    static RegexAST parse(const std::string &pattern, bool flag_s);
+
+    /**
+     * 转义字符\f \n \r \t \v表示对应的控制字符，其余的转义字符表示字符本身
+     * @param c 反斜杠后面的字符
+     */
+    static char unescape(char c);
+
+private:
+    ASTParser(const std::string &pattern, bool flag_s) : pattern(pattern), flag_s(flag_s) {}
+
+    void parseRegex();
+
+    /**
+     * 若pos处是anchor则读入它，返回AnchorFlag，否则返回0
+     */
+    int parseAnchor();
+
+    /**
+     * 读入一个single（单个字符、字符类、.或字符组），返回它能匹配的字节集合
+     */
+    ByteSet parseSingle();
+
+    /**
+     * 读入node之后可能有的量词（含表示非贪婪的?）
+     */
+    void parseQuantifier(int node);
+
+    int parseInteger();
+
+    /**
+     * 读入'['之后的字符组。'^'既可以是取反，也可以是字符组中的字符（如[^]），与ANTLR一样，优先作为取反，此时无法解析才作为字符
+     */
+    ByteSet parseCharacterGroup();
+
+    /**
+     * 从p开始读入一个或多个characterGroupItem和结尾的']'，不抛出异常
+     * @return 是否成功，成功时p为']'之后的位置
+     */
+    bool parseGroupItems(size_t &p, ByteSet &set) const;
+
+    /**
+     * 读入p处的一个charInGroup，返回它表示的字节，p处不是charInGroup时返回-1
+     */
+    int parseCharInGroup(size_t &p) const;
+
+    [[noreturn]] void error(const std::string &message) const;
+
+    const std::string &pattern;
+    bool flag_s;
+    size_t pos = 0;
+    RegexAST ast;
+};
+
+#endif //CPP_ASTPARSER_H
@@ -0,0 +1,97 @@
+#include "bitstate.h"
+
+BitState::BitState(const NFA &nfa, long long max_bits, const Prefilter *prefilter)
+    : nfa(nfa), prefilter(prefilter), max_bits(max_bits)
+{
+    num_slots = 2 * (nfa.group_num + 1);
+}
+
+void BitState::save(const std::vector<int> &slots, int index)
+{
+    for(int slot: slots)
+    {
+        stack.push_back({-1, 0, 0, slot, cap[slot]});
+        cap[slot] = index;
+    }
+}
+
+bool BitState::enter(int q, int index, std::vector<int> &slots)
+{
+    visited.set(q, index - start);
+    if(q < (int)nfa.saves.size())
+        save(nfa.saves[q], index);
+    if(nfa.is_final[q])
+    {
+        slots = cap;
+        slots[1] = index;
+        return true;
+    }
+    stack.push_back({q, index, (int)nfa.rules[q].size() - 1, 0, 0});
+    return false;
+}
+
+/**
+ * 依次以每个位置为起点回溯。访问标记在不同的起点之间不清空：从某个(状态, 位置)出发失败与起点无关
+*/
+bool BitState::exec(std::string_view text, int start, std::vector<int> &slots, int end)
+{
+    int len = text.length();
+    int stop = end < 0 ? len : end; // 只读入stop之前的字节
+    bool anchored = end >= 0;
+    this->start = start;
+    visited.reset(nfa.num_states, stop - start + 1);
+    Prefilter::Cache cache;
+
+    for(int s = start; s < len && (!anchored || s == start); s++)
+    {
+        if(!anchored && prefilter && (s = prefilter->next(text, s, cache)) < 0)
+            break;
+        if(visited.test(0, s - start))
+            continue;
+
+        cap.assign(num_slots, -1);
+        cap[0] = s;
+        stack.clear();
+        if(enter(0, s, slots))
+            return true;
+
+        while(!stack.empty())
+        {
+            job &j = stack.back();
+            if(j.q < 0)
+            {
+                cap[j.slot] = j.old;
+                stack.pop_back();
+                continue;
+            }
+            if(j.next < 0)
+            {
+                stack.pop_back();
+                continue;
+            }
+
+            // 注意enter和save之后j可能失效
+            int index = j.index;
+            const Rule &r = nfa.rules[j.q][j.next--];
+            if(r.type == EPSILON)
+            {
+                if(visited.test(r.dst, index - start) || !checkAnchor(r, text, index, nfa.flag_m))
+                    continue;
+                save(r.saves, index);
+                if(enter(r.dst, index, slots))
+                    return true;
+            }
+            else
+            {
+                if(index >= stop || visited.test(r.dst, index + 1 - start))
+                    continue;
+                if(!nfa.match(r, text[index]) || !checkAnchor(r, text, index, nfa.flag_m))
+                    continue;
+                save(r.saves, index);
+                if(enter(r.dst, index + 1, slots))
+                    return true;
+            }
+        }
+    }
+    return false;
+}
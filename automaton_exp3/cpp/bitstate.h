@@ -0,0 +1,67 @@
+#ifndef CPP_BITSTATE_H
+#define CPP_BITSTATE_H
+
+#include "nfa.h"
+#include "prefilter.h"
+
+/**
+ * 有界的回溯引擎（BitState）：与NFA::exec一样按优先级深度优先地回溯，捕获位置随路径记录，找到的第一个匹配就是结果，
+ * 不需要像PikeVM那样为每个线程复制一份捕获位置。
+ * 每个(状态, 位置)最多展开一次：从它出发一旦失败，无论经由哪条路径到达都会失败，
+ * 因此时间复杂度同样是 O(状态数 × 文本长度)。访问标记是一个状态数 × (文本长度+1) 位的VisitedBitmap，O(1)清空，
+ * 空间只在文本较短时才划算，所以只有这个乘积不超过预算时才使用本引擎，否则由调用者改用PikeVM。
+ */
+class BitState {
+public:
+    static const long long DEFAULT_MAX_BITS = 256 * 1024; // 访问标记的默认预算（位）
+
+    /**
+     * @param nfa 要执行的NFA，需在BitState的生命周期内保持不变
+     * @param max_bits 访问标记最多占用的位数
+     * @param prefilter 可选。只在它给出的位置上开始回溯
+     */
+    explicit BitState(const NFA &nfa, long long max_bits = DEFAULT_MAX_BITS, const Prefilter *prefilter = nullptr);
+
+    /**
+     * 判断在长为len的文本上搜索时，访问标记是否在预算之内。访问标记不区分计数器的值，NFA带计数器时总是false
+     */
+    bool fits(int len) const { return nfa.counters.empty() && (long long)nfa.num_states * (len + 1) <= max_bits; }
+
+    /**
+     * 语义同PikeVM::exec。调用前应当用fits确认text.length()-start（给出end时为end-start）在预算之内
+     */
+    bool exec(std::string_view text, int start, std::vector<int> &slots, int end = -1);
+
+private:
+    /**
+     * 回溯栈中的元素。q>=0 表示正在状态q、位置index上尝试第next条规则（从后往前）；q<0 表示恢复第slot个捕获位置为old
+     */
+    struct job {
+        int q;
+        int index;
+        int next;
+        int slot;
+        int old;
+    };
+
+    /**
+     * 在当前位置记录一组捕获位置，并在栈中压入对应的恢复元素
+     */
+    void save(const std::vector<int> &slots, int index);
+
+    /**
+     * 进入状态q：记录访问标记和q的saves。若q为终态，则得到匹配，写入slots并返回true
+     */
+    bool enter(int q, int index, std::vector<int> &slots);
+
+    const NFA &nfa;
+    const Prefilter *prefilter;
+    long long max_bits;
+    int num_slots;
+    int start = 0; // 本次搜索的起点，访问标记中的位置是相对于它的
+    VisitedBitmap visited;
+    std::vector<job> stack;
+    std::vector<int> cap;
+};
+
+#endif //CPP_BITSTATE_H
@@ -0,0 +1,485 @@
+#include "builder.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+static const long long ESTIMATE_LIMIT = 1LL << 31; // 估计的状态数的上限，大于任何max_states，相乘也不会溢出
+
+/**
+ * 按后序求出每个子表达式展开后的状态个数，与下面各函数新建状态的方式一一对应。只是预分配的提示，偏大偏小都不影响正确性。
+ * 分两遍：第一遍全部展开，同时求出每个子表达式能否匹配空串（anchor视为能匹配空串），{m,n}中的x不能匹配空串、
+ * 且展开后超过unroll_limit时可以使用计数器；再从根往下决定哪些真正使用，第二遍按决定的结果求出状态个数。
+ * 使用计数器的{m,n}中的x只构造一次，其中的{m,n}展开后不超过16 * unroll_limit时仍然展开：嵌套的计数器使PikeVM中
+ * 同一状态上互不支配的计数器的值（见PikeVM::dominates）随文本长度增多，(?:a{1,5000}){1,5000}只用外层的计数器
+*/
+long long NFABuilder::estimateStates()
+{
+    std::vector<long long> count(ast->nodes.size(), 0);
+    std::vector<bool> nullable(ast->nodes.size(), false), candidate(ast->nodes.size(), false);
+    std::vector<bool> inside(ast->nodes.size(), false); // 祖先中有使用计数器的{m,n}
+    std::vector<int> order = ast->postorder();
+    use_counter.assign(ast->nodes.size(), false);
+    for(int pass = 0; pass < 2; pass++)
+    {
+        if(pass == 1)
+            for(auto it = order.rbegin(); it != order.rend(); ++it)
+            {
+                const RegexNode &node = ast->nodes[*it];
+                use_counter[*it] = candidate[*it] && (!inside[*it] || count[*it] > 16LL * unroll_limit);
+                for(int c = node.child; c >= 0; c = ast->nodes[c].next)
+                    inside[c] = inside[*it] || use_counter[*it];
+            }
+        for(int n: order)
+            count[n] = estimate(n, count, nullable, candidate);
+    }
+    return ast->root < 0 ? 1 : std::min(count[ast->root] + 1, ESTIMATE_LIMIT);
+}
+
+/**
+ * 由子结点的结果求出结点n的状态个数和nullable[n]，{m,n}按use_counter[n]构造；第一遍时还求出candidate[n]
+*/
+long long NFABuilder::estimate(int n, const std::vector<long long> &count, std::vector<bool> &nullable,
+                               std::vector<bool> &candidate) const
+{
+    const RegexNode &node = ast->nodes[n];
+    long long sum = 0;
+    // 选择中有一个分支能匹配空串即可，连接中需要每一项都能
+    bool empty = node.type != NODE_ALTERNATION;
+    for(int c = node.child; c >= 0; c = ast->nodes[c].next)
+    {
+        sum += count[c] + (node.type == NODE_ALTERNATION);
+        empty = node.type == NODE_ALTERNATION ? empty || nullable[c] : empty && nullable[c];
+    }
+    if(node.type == NODE_ALTERNATION)
+        sum++;
+    else if(node.type == NODE_SET || node.type == NODE_ANCHOR)
+    {
+        sum = 1;
+        empty = node.type == NODE_ANCHOR;
+    }
+
+    if(node.type == NODE_SET || node.type == NODE_GROUP)
+    {
+        if(node.quantifier == QUANT_NONE)
+            sum += 1;
+        else if(node.quantifier == QUANT_RANGE)
+        {
+            long long copies = node.max < 0 ? node.min + 1 : std::max(node.min, node.max);
+            candidate[n] = candidate[n] || (!empty && copies >= 2 && copies * (sum + 2) > unroll_limit);
+            sum = use_counter[n] ? sum + 2 : copies * (sum + 2) + (node.max < 0);
+            empty = empty || node.min == 0;
+        }
+        else
+        {
+            sum += 3;
+            empty = empty || node.quantifier != QUANT_ONE_OR_MORE;
+        }
+    }
+    nullable[n] = empty;
+    return std::min(sum, ESTIMATE_LIMIT);
+}
+
+/**
+ * 初态0是第一个片段开始时的最后一个状态，构造完成后的最后一个状态是终态
+*/
+void NFABuilder::build(const RegexAST &ast)
+{
+    this->ast = &ast;
+    set_index.assign(ast.sets.size(), -1);
+    nfa.rules.reserve(std::min(estimateStates(), (long long)max_states));
+    newState();
+
+    push(ast.root);
+    while(!stack.empty())
+    {
+        int f = stack.size() - 1;
+        const RegexNode &node = ast.nodes[stack[f].node];
+        if(node.type == NODE_ALTERNATION)
+            alternation(f);
+        else if(node.type == NODE_CONCAT)
+            concat(f);
+        else if(node.quantifier == QUANT_RANGE && use_counter[stack[f].node])
+            counted(f);
+        else if(node.quantifier == QUANT_RANGE)
+            range(f);
+        else
+            item(f);
+    }
+    nfa.group_num = ast.group_num;
+}
+
+void NFABuilder::push(int node)
+{
+    stack.emplace_back();
+    stack.back().node = node;
+}
+
+void NFABuilder::epsilon(int from, int to, int guard)
+{
+    Rule r;
+    r.dst = to;
+    r.type = EPSILON;
+    r.guard = guard;
+    nfa.rules[from].push_back(r);
+}
+
+void NFABuilder::addGroup(int k, int begin, int end)
+{
+    nfa.addGroup(k, begin, end);
+    log.push_back({k, begin, end});
+}
+
+int NFABuilder::internSet(const ByteSet &set)
+{
+    auto it = interned.find(set);
+    if(it != interned.end())
+        return it->second;
+    nfa.sets.push_back(set);
+    interned[set] = nfa.sets.size() - 1;
+    return nfa.sets.size() - 1;
+}
+
+void NFABuilder::single(int set)
+{
+    if(set_index[set] < 0)
+        set_index[set] = internSet(ast->sets[set]);
+    Rule r;
+    r.dst = nfa.num_states;
+    r.type = NORMAL;
+    r.set = set_index[set];
+    nfa.rules[lastState()].push_back(r);
+    newState();
+}
+
+/**
+ * 对于每个分支，先从开始的状态新建一条转移到新状态，再连接这个分支；所有分支的出口最后汇总到一个新状态。
+ * 越靠前的分支优先级越高，应排在rules的越后面：分支的入口按顺序追加之后整段反转
+*/
+void NFABuilder::alternation(int f)
+{
+    Frame &fr = stack[f];
+    const RegexNode &node = ast->nodes[fr.node];
+    if(fr.phase == 0)
+    {
+        fr.state = lastState();
+        fr.child = node.child;
+        fr.patch_base = patches.size();
+        fr.phase = 1;
+    }
+    else
+        patches.push_back(lastState()); // 上一个分支编译完了
+
+    if(fr.child >= 0)
+    {
+        int c = fr.child;
+        fr.child = ast->nodes[c].next;
+        epsilon(fr.state, nfa.num_states);
+        newState();
+        push(c);
+        return;
+    }
+
+    // fr.state在编译第一个分支之前是新建的状态，它的转移全部是分支的入口
+    std::reverse(nfa.rules[fr.state].begin(), nfa.rules[fr.state].end());
+    for(int i = fr.patch_base; i < (int)patches.size(); i++)
+        epsilon(patches[i], nfa.num_states);
+    newState();
+    patches.resize(fr.patch_base);
+    stack.pop_back();
+}
+
+void NFABuilder::concat(int f)
+{
+    Frame &fr = stack[f];
+    if(fr.phase == 0)
+    {
+        fr.child = ast->nodes[fr.node].child;
+        fr.phase = 1;
+    }
+    if(fr.child < 0)
+    {
+        stack.pop_back();
+        return;
+    }
+    int c = fr.child;
+    fr.child = ast->nodes[c].next;
+    push(c);
+}
+
+/**
+ * 对于有量词的项，需要在外围添加其他epsilon转移：
+ * tmp1 在当前最开始的状态后接一个状态，作为该部分item的开头
+ * tmp2 在该item的末尾后接一个状态
+ * tmp3 将最开始的状态直接跨过该item，连接到最后那个状态
+ * tmp4 将最后那个状态返回指向最开始的状态
+ * tmp5 连在当前item的末尾，作为下一个item的起点
+ * 对于贪婪匹配与否的处理，主要就是这些规则添加的先后顺序。
+ * phase 0：编译子结点之前；phase 1：分组的子结点编译完之后
+*/
+void NFABuilder::item(int f)
+{
+    Frame &fr = stack[f];
+    const RegexNode &node = ast->nodes[fr.node];
+    if(fr.phase == 0)
+    {
+        fr.state = lastState();
+        if(node.type == NODE_ANCHOR)
+        {
+            epsilon(fr.state, nfa.num_states, node.value);
+            newState();
+            stack.pop_back();
+            return;
+        }
+        if(node.quantifier != QUANT_NONE)
+        {
+            epsilon(fr.state, nfa.num_states); // tmp1
+            newState();
+        }
+        if(node.type == NODE_GROUP)
+        {
+            fr.phase = 1;
+            push(node.child);
+            return;
+        }
+        single(node.value);
+    }
+    else if(node.value >= 0)
+        addGroup(node.value, node.quantifier == QUANT_NONE ? fr.state : fr.state + 1, lastState());
+
+    int state = fr.state;
+    bool lazy = node.lazy;
+    QuantifierType quantifier = node.quantifier;
+    stack.pop_back();
+
+    epsilon(lastState(), nfa.num_states); // tmp2，不带量词时为tmp5
+    newState();
+    if(quantifier == QUANT_NONE)
+        return;
+
+    int end = lastState();
+    epsilon(end, nfa.num_states); // tmp5
+    newState();
+
+    std::vector<Rule> &begin_rules = nfa.rules[state];
+    std::vector<Rule> &end_rules = nfa.rules[end];
+    Rule skip; // tmp3
+    skip.dst = end;
+    skip.type = EPSILON;
+    Rule loop; // tmp4
+    loop.dst = state;
+    loop.type = EPSILON;
+
+    if(quantifier != QUANT_ONE_OR_MORE)
+    {
+        if(lazy)
+            begin_rules.push_back(skip);
+        else
+            begin_rules.insert(begin_rules.begin(), skip);
+    }
+    if(quantifier != QUANT_ZERO_OR_ONE)
+    {
+        if(lazy)
+            end_rules.insert(end_rules.begin(), loop);
+        else
+            end_rules.push_back(loop);
+    }
+}
+
+/**
+ * x{m,n}展开为m份x，后接n-m个嵌套的ZeroOrOne：x{2,4} 即 xx(x(x)?)?。
+ * 跳过某一份时直接跳到最后，而不是跳到下一份，否则每一份的epsilon闭包都包含之后所有的份，消去epsilon转移后转移的条数是平方级的。
+ * x{m,}展开为m份x后接一份ZeroOrMore。可以跳过的各份的开头记在patches中，所有份都展开之后再连接。
+ * phase 0：刚入栈；phase 1：展开下一份；phase 2：第一份的子结点编译完之后
+*/
+void NFABuilder::range(int f)
+{
+    const RegexNode &node = ast->nodes[stack[f].node];
+    int copies = node.max < 0 ? node.min + 1 : std::max(node.min, node.max);
+    if(stack[f].phase == 0)
+    {
+        stack[f].child = 0;
+        stack[f].patch_base = patches.size();
+        stack[f].phase = 1;
+    }
+    else if(stack[f].phase == 2)
+    {
+        stack[f].phase = 1;
+        endCopy(f);
+    }
+
+    while(stack[f].child < copies)
+    {
+        Frame &fr = stack[f];
+        fr.copy = lastState();
+        epsilon(fr.copy, nfa.num_states); // tmp1
+        if(fr.first >= 0)
+            clone(fr.first, fr.last, fr.log_begin, fr.log_end);
+        else
+        {
+            newState();
+            fr.log_begin = log.size();
+            if(node.type == NODE_GROUP)
+            {
+                fr.phase = 2;
+                push(node.child);
+                return;
+            }
+            single(node.value);
+        }
+        endCopy(f);
+    }
+
+    Frame &fr = stack[f];
+    if(node.max >= 0)
+    {
+        for(int i = fr.patch_base; i < (int)patches.size(); i++)
+        {
+            Rule skip; // tmp3
+            skip.dst = lastState();
+            skip.type = EPSILON;
+            std::vector<Rule> &rules = nfa.rules[patches[i]];
+            if(node.lazy)
+                rules.push_back(skip);
+            else
+                rules.insert(rules.begin(), skip);
+        }
+    }
+    else
+    {
+        // 最后一份相当于ZeroOrMore
+        int copy = patches.back();
+        int end = lastState();
+        epsilon(end, nfa.num_states); // tmp5
+        newState();
+
+        Rule skip; // tmp3
+        skip.dst = end;
+        skip.type = EPSILON;
+        Rule loop; // tmp4
+        loop.dst = copy;
+        loop.type = EPSILON;
+        if(node.lazy)
+        {
+            nfa.rules[copy].push_back(skip);
+            nfa.rules[end].insert(nfa.rules[end].begin(), loop);
+        }
+        else
+        {
+            nfa.rules[copy].insert(nfa.rules[copy].begin(), skip);
+            nfa.rules[end].push_back(loop);
+        }
+    }
+    patches.resize(fr.patch_base);
+    stack.pop_back();
+}
+
+/**
+ * x{m,n}只编译一份x：开头的状态经由RESET进入x，x的结尾经由LOOP回到x的开头，或经由EXIT到达新的最后一个状态，
+ * m为0时开头另有一条跳过x的转移（同tmp3）。贪婪时LOOP比EXIT优先，非贪婪时相反。
+ * x中的分组只记录一份，每次重复都覆盖它的捕获位置，最后一次重复的结果保留下来，与展开时相同。
+ * x不能匹配空串，因此带计数器操作的转移都不在epsilon环上，两次LOOP之间至少读入一个字节
+ * phase 0：编译子结点之前；phase 1：分组的子结点编译完之后
+*/
+void NFABuilder::counted(int f)
+{
+    Frame &fr = stack[f];
+    const RegexNode &node = ast->nodes[fr.node];
+    if(fr.phase == 0)
+    {
+        fr.state = lastState();
+        fr.child = nfa.counters.size();
+        nfa.counters.push_back({node.min, node.max});
+        epsilon(fr.state, nfa.num_states);
+        nfa.rules[fr.state].back().ops.push_back(fr.child * 4 + COUNTER_RESET);
+        newState();
+        if(node.type == NODE_GROUP)
+        {
+            fr.phase = 1;
+            push(node.child);
+            return;
+        }
+        single(node.value);
+    }
+
+    int state = fr.state, begin = fr.state + 1, end = lastState(), counter = fr.child;
+    if(node.type == NODE_GROUP && node.value >= 0)
+        addGroup(node.value, begin, end);
+    stack.pop_back();
+
+    Rule loop;
+    loop.dst = begin;
+    loop.type = EPSILON;
+    loop.ops.push_back(counter * 4 + COUNTER_LOOP);
+    Rule exit;
+    exit.dst = newState();
+    exit.type = EPSILON;
+    exit.ops.push_back(counter * 4 + COUNTER_EXIT);
+    nfa.rules[end].push_back(node.lazy ? loop : exit);
+    nfa.rules[end].push_back(node.lazy ? exit : loop);
+
+    if(node.min == 0)
+    {
+        Rule skip; // tmp3
+        skip.dst = exit.dst;
+        skip.type = EPSILON;
+        std::vector<Rule> &rules = nfa.rules[state];
+        if(node.lazy)
+            rules.push_back(skip);
+        else
+            rules.insert(rules.begin(), skip);
+    }
+}
+
+void NFABuilder::endCopy(int f)
+{
+    Frame &fr = stack[f];
+    const RegexNode &node = ast->nodes[fr.node];
+    if(fr.first < 0)
+    {
+        fr.first = fr.copy + 1;
+        fr.last = lastState();
+        fr.log_end = log.size();
+    }
+    if(node.type == NODE_GROUP && node.value >= 0)
+        addGroup(node.value, fr.copy + 1, lastState());
+
+    epsilon(lastState(), nfa.num_states); // tmp2
+    newState();
+    if(fr.child >= node.min)
+        patches.push_back(fr.copy);
+    fr.child++;
+}
+
+int NFABuilder::newState()
+{
+    if(nfa.num_states >= max_states)
+        throw std::runtime_error("正则表达式展开后的NFA状态数超过了上限" + std::to_string(max_states) + "！");
+    return nfa.addState();
+}
+
+/**
+ * 指向范围内的转移改为指向对应的新状态，指向范围外的转移（第一份的结尾之后接上的tmp2等）不复制
+*/
+void NFABuilder::clone(int first, int last, int log_begin, int log_end)
+{
+    int offset = nfa.num_states - first;
+    // 一次复制整份，先检查，不必复制到一半才发现超出上限
+    if((long long)nfa.num_states + (last - first + 1) > max_states)
+        throw std::runtime_error("正则表达式展开后的NFA状态数超过了上限" + std::to_string(max_states) + "！");
+    for(int q = first; q <= last; q++)
+    {
+        int c = newState();
+        for(const Rule &r: nfa.rules[q])
+        {
+            if(r.dst < first || r.dst > last)
+                continue;
+            nfa.rules[c].push_back(r);
+            nfa.rules[c].back().dst += offset;
+        }
+    }
+    for(int i = log_begin; i < log_end; i++)
+    {
+        GroupEntry g = log[i];
+        addGroup(g.k, g.begin + offset, g.end + offset);
+    }
+}
@@ -0,0 +1,134 @@
+#ifndef CPP_BUILDER_H
+#define CPP_BUILDER_H
+
+#include <unordered_map>
+#include "ast.h"
+
+/**
+ * 由抽象语法树构造NFA（Thompson构造）。每个子表达式编译为一个片段：从当前最后一个状态出发，
+ * 依次追加新的状态和转移，结束于新的最后一个状态，因此片段只有一个出口，连接时不需要回填。
+ * 选择的各分支的出口、{m,n}中可以跳过的各份的入口则先记在一个共用的待连接列表（patches）里，整个选择（量词）编译完之后再统一连接。
+ * 遍历使用显式的栈，嵌套再深也不会耗尽调用栈；每条转移只追加一次（优先级顺序通过整段反转得到，而不是在开头插入），
+ * 总的时间与NFA的大小成线性。
+ */
+class NFABuilder {
+public:
+    /**
+     * @param nfa 要构造的NFA，需为空，构造完成后还需设置终态并消去epsilon转移（见Regex::compile）
+     * @param max_states 允许的最大状态数。{m,n}较小时按份展开，嵌套的上界相乘，超过时抛出std::runtime_error，
+     *        避免一个正则表达式耗尽时间和内存
+     * @param unroll_limit {m,n}展开后的状态数超过它时改用计数器（见counted），状态数与上界无关。
+     *        展开的NFA可以使用DFA等更快的引擎，带计数器的只能用PikeVM。使用计数器的{m,n}中嵌套的{m,n}见estimateStates
+     */
+    explicit NFABuilder(NFA &nfa, int max_states = DEFAULT_MAX_STATES, int unroll_limit = DEFAULT_UNROLL_LIMIT)
+        : nfa(nfa), max_states(max_states), unroll_limit(unroll_limit) {}
+
+    static const int DEFAULT_MAX_STATES = 1 << 20;
+
+    static const int DEFAULT_UNROLL_LIMIT = 4096;
+
+    void build(const RegexAST &ast);
+
+private:
+    /**
+     * 显式栈中的一帧，对应一个正在编译的结点
+     */
+    struct Frame {
+        int node;
+        int phase = 0; // 0表示刚入栈，之后的含义由各结点类型自己决定
+        int state = -1; // 片段开始时的最后一个状态
+        int child = -1; // 下一个要编译的子结点；QUANT_RANGE时为已经完成的份数，使用计数器时为计数器的编号
+        int copy = -1; // QUANT_RANGE中当前这一份开头之前的状态
+        int first = -1, last = -1; // QUANT_RANGE中第一份的状态范围，之后的各份由它复制
+        int log_begin = 0, log_end = 0; // 第一份中记录的分组在log中的范围
+        int patch_base = 0; // 本帧在patches中的起点
+    };
+
+    /**
+     * 估计状态的个数，用于预先分配rules；同时决定哪些{m,n}使用计数器，记在use_counter中
+     */
+    long long estimateStates();
+
+    /**
+     * estimateStates中的一个结点，见它的注释
+     */
+    long long estimate(int n, const std::vector<long long> &count, std::vector<bool> &nullable,
+                       std::vector<bool> &candidate) const;
+
+    void alternation(int f);
+
+    void concat(int f);
+
+    /**
+     * 编译不带量词或带有? * +的一项
+     */
+    void item(int f);
+
+    /**
+     * 编译带有{m,n}的一项：展开为若干份，第一份编译子结点，其余各份复制第一份
+     */
+    void range(int f);
+
+    /**
+     * 编译使用计数器的{m,n}：只编译一份子结点，重复的次数由计数器记录
+     */
+    void counted(int f);
+
+    /**
+     * range中一份的开头或子结点部分编译完之后的收尾
+     */
+    void endCopy(int f);
+
+    /**
+     * 从最后一个状态出发，接一条匹配字节集合的转移到新状态
+     */
+    void single(int set);
+
+    /**
+     * 把状态[first, last]连同其间的转移复制一份，追加在最后。指向范围外的转移不复制，
+     * log中[log_begin, log_end)的分组也复制一份
+     */
+    void clone(int first, int last, int log_begin, int log_end);
+
+    /**
+     * 新建一个状态，超过max_states时抛出异常
+     */
+    int newState();
+
+    void epsilon(int from, int to, int guard = 0);
+
+    void addGroup(int k, int begin, int end);
+
+    void push(int node);
+
+    int lastState() const { return nfa.num_states - 1; }
+
+    /**
+     * 用哈希表代替NFA::internSet的线性查找
+     */
+    int internSet(const ByteSet &set);
+
+    struct ByteSetHash {
+        size_t operator()(const ByteSet &s) const { return s.bits[0] * 31 + s.bits[1] * 17 + s.bits[2] * 7 + s.bits[3]; }
+    };
+
+    NFA &nfa;
+    int max_states;
+    int unroll_limit;
+    const RegexAST *ast = nullptr;
+    std::vector<Frame> stack;
+    std::vector<int> patches; // 待连接的状态，各帧用[patch_base, size)中的一段
+    std::vector<int> set_index; // AST中的集合在nfa.sets中的下标，-1表示还没有加入
+    std::vector<bool> use_counter; // use_counter[n]表示结点n上的{m,n}使用计数器
+    std::unordered_map<ByteSet, int, ByteSetHash> interned;
+
+    /**
+     * 按构造顺序记录的所有分组(k, 起始状态, 结束状态)。{m,n}的第一份中的分组是连续的一段，复制时只需复制这一段
+     */
+    struct GroupEntry {
+        int k, begin, end;
+    };
+    std::vector<GroupEntry> log;
+};
+
+#endif //CPP_BUILDER_H
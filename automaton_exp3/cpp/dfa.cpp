@@ -0,0 +1,392 @@
+#include "dfa.h"
+#include <map>
+#include <algorithm>
+#include <stdexcept>
+
+/**
+ * 子集构造中DFA状态的上下文标志
+ */
+enum {
+    CTX_WORD = 1, // 前一个字符是单词字符
+    CTX_BEGIN = 2, // 当前位置满足^
+};
+
+/**
+ * 求NFA状态集合在给定上下文下的epsilon闭包
+ * @param next 下一个字节，-1表示文本结尾
+ * @param mark 临时空间，mark[q]==gen表示q已在闭包中
+ * @return 闭包中是否含有终态
+*/
+static bool epsilonClosure(const NFA &nfa, const std::vector<int> &kernel, int ctx, int next,
+                           std::vector<int> &closure, std::vector<int> &mark, int gen)
+{
+    bool prev_word = ctx & CTX_WORD;
+    bool final = false;
+
+    closure.clear();
+    std::vector<int> stack(kernel.begin(), kernel.end());
+    while(!stack.empty())
+    {
+        int q = stack.back();
+        stack.pop_back();
+        if(mark[q] == gen)
+            continue;
+        mark[q] = gen;
+        closure.push_back(q);
+        if(nfa.is_final[q])
+            final = true;
+
+        for(const Rule &r: nfa.rules[q])
+        {
+            if(r.type != EPSILON || mark[r.dst] == gen)
+                continue;
+            if(guardHolds(r.guard, ctx & CTX_BEGIN, prev_word, next, nfa.flag_m))
+                stack.push_back(r.dst);
+        }
+    }
+    return final;
+}
+
+/**
+ * 子集构造。DFA状态为（尚未求闭包的NFA状态集合，上下文标志），
+ * 因为anchor要等到下一个字节已知时才能判断，闭包在转移时才计算。
+*/
+DFA DFA::from_nfa(const NFA &nfa, int max_states)
+{
+    if(!nfa.counters.empty())
+        throw std::runtime_error("带计数器的NFA不能转换为DFA！");
+    bool need_word = false, need_begin = false;
+    for(int i = 0; i < nfa.num_states; i++)
+        for(const Rule &r: nfa.rules[i])
+        {
+            if(r.guard & (ANCHOR_WORD | ANCHOR_NOT_WORD))
+                need_word = true;
+            if(r.guard & ANCHOR_BEGIN)
+                need_begin = true;
+        }
+
+    DFA dfa;
+    std::copy(nfa.classes, nfa.classes + 256, dfa.classes);
+    dfa.num_classes = nfa.num_classes;
+    std::vector<std::pair<int, std::vector<int>>> sets;
+    std::map<std::pair<int, std::vector<int>>, int> index;
+
+    auto add = [&](std::vector<int> &kernel, int ctx) {
+        if(!need_word)
+            ctx &= ~CTX_WORD;
+        if(!need_begin)
+            ctx &= ~CTX_BEGIN;
+        std::sort(kernel.begin(), kernel.end());
+        auto key = std::make_pair(ctx, kernel);
+        auto it = index.find(key);
+        if(it != index.end())
+            return it->second;
+        if((int)sets.size() >= max_states)
+            throw std::runtime_error("DFA的状态数超过了上限" + std::to_string(max_states) + "！");
+        int s = sets.size();
+        sets.push_back(key);
+        index[key] = s;
+        return s;
+    };
+
+    std::vector<int> mark(nfa.num_states, 0), seen(nfa.num_states, 0);
+    int gen = 0;
+    std::vector<int> closure, kernel;
+
+    std::vector<int> init{0};
+    dfa.start = add(init, CTX_BEGIN);
+
+    for(int s = 0; s < (int)sets.size(); s++)
+    {
+        int ctx = sets[s].first;
+        std::vector<int> cur = sets[s].second;
+
+        dfa.is_final.push_back(epsilonClosure(nfa, cur, ctx, -1, closure, mark, ++gen));
+
+        // 同一等价类中的字节结果相同，只需用代表元计算
+        for(int k = 0; k < nfa.num_classes; k++)
+        {
+            int c = nfa.class_rep[k];
+            epsilonClosure(nfa, cur, ctx, c, closure, mark, ++gen);
+
+            kernel.clear();
+            for(int q: closure)
+                for(const Rule &r: nfa.rules[q])
+                    if(r.type != EPSILON && seen[r.dst] != gen && nfa.match(r, (char)c) &&
+                       guardHolds(r.guard, ctx & CTX_BEGIN, ctx & CTX_WORD, c, nfa.flag_m))
+                    {
+                        seen[r.dst] = gen;
+                        kernel.push_back(r.dst);
+                    }
+
+            int next_ctx = 0;
+            if(w((char)c))
+                next_ctx |= CTX_WORD;
+            if(nfa.flag_m && c == '\n')
+                next_ctx |= CTX_BEGIN;
+            dfa.table.push_back(add(kernel, next_ctx));
+        }
+    }
+
+    dfa.num_states = sets.size();
+    for(int s = 0; s < dfa.num_states; s++)
+        if(sets[s].second.empty() && !dfa.is_final[s])
+            dfa.dead = s;
+    return dfa;
+}
+
+/**
+ * Hopcroft算法：从{终态, 非终态}的划分出发，不断用(块A, 等价类c)去切分其他块——
+ * 读入c后进入A的状态与不进入A的状态必须分开。被切分的块若已在待处理队列中则两半都加入，否则只加入较小的一半。
+*/
+void DFA::minimize()
+{
+    int n = num_states, K = num_classes;
+
+    // 逆转移，按等价类分桶：inv[inv_start[c*n+t] .. inv_start[c*n+t+1])为读入c到达t的所有状态
+    std::vector<int> inv_start(K * n + 1, 0), inv(K * n);
+    for(int s = 0; s < n; s++)
+        for(int c = 0; c < K; c++)
+            inv_start[c * n + table[s * K + c] + 1]++;
+    for(int i = 0; i < K * n; i++)
+        inv_start[i + 1] += inv_start[i];
+    {
+        std::vector<int> fill(inv_start.begin(), inv_start.end() - 1);
+        for(int s = 0; s < n; s++)
+            for(int c = 0; c < K; c++)
+                inv[fill[c * n + table[s * K + c]]++] = s;
+    }
+
+    // 划分：elems中每个块占连续的一段[first[b], end[b])，loc[q]为q在elems中的下标
+    std::vector<int> elems(n), loc(n), block(n), first, end, marked;
+    int pos = 0;
+    for(int f = 0; f < 2; f++)
+    {
+        int b = first.size();
+        first.push_back(pos);
+        for(int s = 0; s < n; s++)
+            if(is_final[s] == (bool)f)
+            {
+                elems[pos] = s;
+                loc[s] = pos++;
+                block[s] = b;
+            }
+        end.push_back(pos);
+        marked.push_back(0);
+        if(end[b] == first[b])
+        {
+            first.pop_back();
+            end.pop_back();
+            marked.pop_back();
+        }
+    }
+
+    std::vector<std::pair<int, int>> work;
+    std::vector<bool> in_work; // in_work[b*K+c]
+    auto push = [&](int b, int c) {
+        if((int)in_work.size() < (b + 1) * K)
+            in_work.resize((b + 1) * K, false);
+        if(!in_work[b * K + c])
+        {
+            in_work[b * K + c] = true;
+            work.push_back({b, c});
+        }
+    };
+    for(int c = 0; c < K; c++)
+        for(int b = 0; b < (int)first.size(); b++)
+            push(b, c);
+
+    std::vector<int> x, touched;
+    while(!work.empty())
+    {
+        int a = work.back().first, c = work.back().second;
+        work.pop_back();
+        in_work[a * K + c] = false;
+
+        x.clear();
+        for(int i = first[a]; i < end[a]; i++)
+        {
+            int t = elems[i];
+            x.insert(x.end(), inv.begin() + inv_start[c * n + t], inv.begin() + inv_start[c * n + t + 1]);
+        }
+
+        // 将x中的状态移到各自所在块的前部
+        touched.clear();
+        for(int s: x)
+        {
+            int b = block[s];
+            int p = first[b] + marked[b];
+            if(loc[s] < p)
+                continue;
+            if(marked[b] == 0)
+                touched.push_back(b);
+            int other = elems[p];
+            std::swap(elems[p], elems[loc[s]]);
+            loc[other] = loc[s];
+            loc[s] = p;
+            marked[b]++;
+        }
+
+        for(int b: touched)
+        {
+            int m = marked[b];
+            marked[b] = 0;
+            if(m == end[b] - first[b])
+                continue;
+
+            // 被标记的前半部分成为新块nb
+            int nb = first.size();
+            first.push_back(first[b]);
+            end.push_back(first[b] + m);
+            marked.push_back(0);
+            first[b] += m;
+            for(int i = first[nb]; i < end[nb]; i++)
+                block[elems[i]] = nb;
+
+            int small = (end[nb] - first[nb] <= end[b] - first[b]) ? nb : b;
+            for(int d = 0; d < K; d++)
+            {
+                if((int)in_work.size() > b * K + d && in_work[b * K + d])
+                    push(nb, d);
+                else
+                    push(small, d);
+            }
+        }
+    }
+
+    // 每个块成为一个新状态，初态所在的块编号为0
+    int m = first.size();
+    std::vector<int> rename(m, -1);
+    std::vector<int> order{block[start]};
+    rename[block[start]] = 0;
+    for(int b = 0; b < m; b++)
+        if(rename[b] < 0)
+        {
+            rename[b] = order.size();
+            order.push_back(b);
+        }
+
+    std::vector<int> new_table(m * K);
+    std::vector<bool> new_final(m);
+    for(int i = 0; i < m; i++)
+    {
+        int s = elems[first[order[i]]];
+        new_final[i] = is_final[s];
+        for(int c = 0; c < K; c++)
+            new_table[i * K + c] = rename[block[table[s * K + c]]];
+    }
+
+    num_states = m;
+    start = 0;
+    table.swap(new_table);
+    is_final.swap(new_final);
+    dead = -1;
+    for(int s = 0; s < m; s++)
+    {
+        bool self = !is_final[s];
+        for(int c = 0; c < K && self; c++)
+            self = table[s * K + c] == s;
+        if(self)
+            dead = s;
+    }
+}
+
+/**
+ * 在DFA上执行指定的输入字符串，每个字节查一次表；进入dead状态后可以直接拒绝
+*/
+bool DFA::exec(std::string_view text) const
+{
+    return is_final[run(text, start)];
+}
+
+int DFA::run(std::string_view text, int s) const
+{
+    for(unsigned char c: text)
+    {
+        s = table[s * num_classes + classes[c]];
+        if(s == dead)
+            return s;
+    }
+    return s;
+}
+
+/**
+ * 每块的模拟中，cur为当前仍然不同的状态，from[i]为从状态i出发的模拟对应cur中的哪一个。
+ * 每读入若干字节合并一次cur中相同的状态；只剩一个时改用run。全都进入dead时本块之后的字节不必再读
+*/
+bool DFA::exec(std::string_view text, int threads, ThreadPool &pool) const
+{
+    if(threads <= 0 || threads > pool.size())
+        threads = pool.size();
+    // 超过2GB的单个输入正是分块并行的主要对象，长度和块的边界都不能用int
+    size_t len = text.length();
+    int chunks = std::min<size_t>(threads * 4, len / std::max(parallel_chunk, 1));
+    if(threads == 1 || chunks < 2 || num_states > MAX_PARALLEL_STATES)
+        return exec(text);
+
+    std::vector<size_t> ends(chunks);
+    for(int i = 0; i < chunks; i++)
+        ends[i] = len / chunks * (i + 1) + len % chunks * (i + 1) / chunks; // 即len * (i + 1) / chunks，不会溢出
+
+    // maps[i][q]为从状态q进入第i块时离开它的状态；第0块只从初态出发
+    std::vector<std::vector<int>> maps(chunks);
+    auto simulate = [&](int i) {
+        size_t begin = i > 0 ? ends[i - 1] : 0;
+        std::string_view chunk = text.substr(begin, ends[i] - begin);
+        if(i == 0)
+        {
+            maps[i].assign(num_states, -1);
+            maps[i][start] = run(chunk, start);
+            return;
+        }
+
+        std::vector<int> cur(num_states), from(num_states), index(num_states, -1), merged;
+        for(int q = 0; q < num_states; q++)
+            cur[q] = from[q] = q;
+        const int MERGE_INTERVAL = 32;
+        size_t pos = 0;
+        while(pos < chunk.size() && cur.size() > 1)
+        {
+            size_t stop = std::min(chunk.size(), pos + MERGE_INTERVAL);
+            for(; pos < stop; pos++)
+            {
+                const int *row = table.data() + classes[(unsigned char)chunk[pos]];
+                for(int &s: cur)
+                    s = row[s * num_classes];
+            }
+
+            // 合并相同的状态，index[s]为状态s在新的cur中的下标
+            merged.clear();
+            for(int &k: from)
+            {
+                int s = cur[k];
+                if(index[s] < 0)
+                {
+                    index[s] = merged.size();
+                    merged.push_back(s);
+                }
+                k = index[s];
+            }
+            for(int s: merged)
+                index[s] = -1;
+            cur.swap(merged);
+            if(cur.size() == 1 && cur[0] == dead)
+                break;
+        }
+        if(cur.size() == 1)
+            cur[0] = run(chunk.substr(std::min(pos, chunk.size())), cur[0]);
+
+        maps[i].resize(num_states);
+        for(int q = 0; q < num_states; q++)
+            maps[i][q] = cur[from[q]];
+    };
+    pool.parallelFor(chunks, 1, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+            simulate(i);
+    });
+
+    int s = start;
+    for(int i = 0; i < chunks; i++)
+        s = maps[i][s];
+    return is_final[s];
+}
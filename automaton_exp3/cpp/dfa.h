@@ -0,0 +1,64 @@
+#ifndef CPP_DFA_H
+#define CPP_DFA_H
+
+#include "nfa.h"
+#include "threadpool.h"
+
+/**
+ * 由NFA预先构造出的完整DFA：子集构造 + Hopcroft最小化，转移保存在稠密的二维表中，执行时每个字节查一次表。
+ * 与NFA::exec只要求到达终态不同，DFA判断的是整个输入串能否被NFA接受（即第一次实验中自动机的语义）。
+ * NFA中带anchor的epsilon转移（^ $ \b \B）同样被支持：DFA状态中记录前一个字符的上下文，
+ * 转移时下一个字符已知，输入结束时则以“下一个字符是文本结尾”来判断是否接受。
+ * 转移表按NFA的字节等价类（NFA::classes）而不是按字节存放，同一类中的字节总是到达同一个状态。
+ * 本类定义的自动机，状态用编号0~(num_states-1)表示，初态为start。
+ */
+class DFA {
+public:
+    int num_states = 0; // 状态个数
+    int start = 0; // 初态
+    std::vector<bool> is_final; // is_final[i]为true表示输入在状态i结束时接受
+    unsigned char classes[256] = {}; // 字节所属的等价类，与NFA::classes相同
+    int num_classes = 1; // 等价类的个数
+    std::vector<int> table; // 转移表，长为num_states*num_classes。table[i*num_classes+classes[c]]表示状态i读入字节c后到达的状态
+    int dead = -1; // 无论再读入什么都不可能接受的状态，没有则为-1
+
+    /**
+     * 对NFA做子集构造，得到（未最小化的）DFA
+     * @param nfa 要转换的NFA，可以是NFA::from_text读入的，也可以是Regex编译出的。带计数器时抛出std::runtime_error
+     * @param max_states 允许的最大状态数，超过时抛出异常
+     */
+    static DFA from_nfa(const NFA &nfa, int max_states = 100000);
+
+    /**
+     * Hopcroft算法最小化，原地修改
+     */
+    void minimize();
+
+    /**
+     * 在DFA上执行指定的输入字符串
+     * @param text 输入字符串
+     * @return 是否接受
+     */
+    bool exec(std::string_view text) const;
+
+    /**
+     * 同exec，状态数不超过MAX_PARALLEL_STATES、输入至少有两块（parallel_chunk）时分块并行执行：
+     * 除第一块外，每块都从所有状态同时出发模拟一遍，得到“进入本块时的状态 -> 离开本块时的状态”的映射，
+     * 最后从初态出发依次查各块的映射。从不同状态出发的模拟一旦到达同一个状态就合并，之后只需计算一次，
+     * 通常很快就只剩下一两个不同的状态，每块的代价接近单独执行一遍。结果与exec完全相同
+     * @param threads 分块的依据，输入最多分为threads*4块，为1时不分块；0或超过pool的线程数时取pool的线程数
+     * @param pool 执行各块的线程池
+     */
+    bool exec(std::string_view text, int threads, ThreadPool &pool = ThreadPool::global()) const;
+
+    /**
+     * 从状态s开始读入text，返回到达的状态（进入dead后不再继续读）
+     */
+    int run(std::string_view text, int s) const;
+
+    int parallel_chunk = 1 << 18; // 并行执行时每块的最小字节数
+
+    static const int MAX_PARALLEL_STATES = 64; // 并行执行时每块要从所有状态出发，状态更多时不分块
+};
+
+#endif //CPP_DFA_H
@@ -0,0 +1,126 @@
+#include "glushkov.h"
+
+bool Glushkov::eligible(const NFA &nfa)
+{
+    if(!nfa.counters.empty())
+        return false;
+    int n = 0;
+    for(int i = 0; i < nfa.num_states; i++)
+        for(const Rule &r: nfa.rules[i])
+        {
+            if(r.guard != 0)
+                return false;
+            if(r.type != EPSILON)
+                n++;
+        }
+    return n <= MAX_POSITIONS;
+}
+
+/**
+ * 求状态q的epsilon闭包
+ * @param final 输出，闭包中是否有终态
+ * @return 闭包中所有的状态
+*/
+static std::vector<int> closureOf(const NFA &nfa, int q, bool &final)
+{
+    std::vector<bool> visited(nfa.num_states, false);
+    std::vector<int> stack{q}, result;
+    visited[q] = true;
+    final = false;
+    while(!stack.empty())
+    {
+        int s = stack.back();
+        stack.pop_back();
+        result.push_back(s);
+        if(nfa.is_final[s])
+            final = true;
+        for(const Rule &r: nfa.rules[s])
+            if(r.type == EPSILON && !visited[r.dst])
+            {
+                visited[r.dst] = true;
+                stack.push_back(r.dst);
+            }
+    }
+    return result;
+}
+
+/**
+ * 构造位置自动机：按状态编号、规则顺序给每条非epsilon转移编号，
+ * 编译出的连接关系大多成为相邻的编号，可以交给移位处理
+*/
+Glushkov::Glushkov(const NFA &nfa, const Prefilter *prefilter) : prefilter(prefilter)
+{
+    // out[q]为从状态q出发的非epsilon转移所对应的位置
+    std::vector<std::vector<int>> out(nfa.num_states);
+    std::vector<int> dst;
+    for(int i = 0; i < nfa.num_states; i++)
+        for(const Rule &r: nfa.rules[i])
+            if(r.type != EPSILON)
+            {
+                int p = num_positions++;
+                out[i].push_back(p);
+                dst.push_back(r.dst);
+                for(int c = 0; c < 256; c++)
+                    if(nfa.sets[r.set].test(c))
+                        mask[c] |= 1ULL << p;
+            }
+
+    // 消去epsilon转移：位置p之后可以跟随的位置，是从dst[p]的epsilon闭包中出发的所有位置
+    auto reach = [&](int q, bool &final) {
+        uint64_t set = 0;
+        for(int s: closureOf(nfa, q, final))
+            for(int p: out[s])
+                set |= 1ULL << p;
+        return set;
+    };
+
+    first = reach(0, empty_match);
+
+    int groups = (num_positions + 7) / 8;
+    follow.assign(groups * 256, 0);
+    for(int p = 0; p < num_positions; p++)
+    {
+        bool final;
+        uint64_t f = reach(dst[p], final);
+        if(final)
+            last |= 1ULL << p;
+        if(p + 1 < num_positions && (f >> (p + 1) & 1))
+        {
+            linear |= 1ULL << (p + 1);
+            f &= ~(1ULL << (p + 1));
+        }
+
+        int k = p / 8, bit = p % 8;
+        for(int b = 0; b < 256; b++)
+            if(b >> bit & 1)
+                follow[k * 256 + b] |= f;
+    }
+}
+
+/**
+ * 每个位置都以最低的代价开启一个新的起点（或上first），因此一趟扫描就完成了所有起点的搜索
+*/
+int Glushkov::searchEarliest(std::string_view text, int start) const
+{
+    int len = text.length();
+    if(start >= len)
+        return -1;
+    if(empty_match)
+        return start;
+
+    int groups = (num_positions + 7) / 8;
+    uint64_t d = 0;
+    Prefilter::Cache cache;
+    for(int index = start; index < len; index++)
+    {
+        if(d == 0 && prefilter && (index = prefilter->next(text, index, cache)) < 0)
+            return -1;
+        uint64_t next = ((d << 1) & linear) | first;
+        for(int k = 0; k < groups; k++)
+            next |= follow[k * 256 + (d >> (8 * k) & 0xff)];
+        d = next & mask[(unsigned char)text[index]];
+        if(d & last)
+            return index + 1;
+    }
+    return -1;
+}
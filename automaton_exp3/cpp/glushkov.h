@@ -0,0 +1,53 @@
+#ifndef CPP_GLUSHKOV_H
+#define CPP_GLUSHKOV_H
+
+#include <cstdint>
+#include "nfa.h"
+#include "prefilter.h"
+
+/**
+ * 位并行的Glushkov位置自动机，适用于较小的、不含anchor的NFA，只回答“是否存在匹配”。
+ * NFA中的每一条非epsilon转移是一个“位置”，epsilon转移（包括compileExpressionItem中的tmp1~tmp5）都被消去，
+ * 于是所有活跃的位置可以用一个uint64_t表示。读入一个字节时：
+ *     D' = (((D << 1) & linear) | follow(D) | first) & mask[c]
+ * 其中 (D << 1) & linear 处理“位置i之后紧跟着位置i+1”这种最常见的连接关系，
+ * follow(D)处理其余的边（循环、分支），按8位一组查表后合并，没有分支，也不需要分配内存。
+ */
+class Glushkov {
+public:
+    static const int MAX_POSITIONS = 64;
+
+    /**
+     * 判断NFA能否使用本引擎：不含anchor和计数器，且非epsilon转移的条数不超过MAX_POSITIONS
+     */
+    static bool eligible(const NFA &nfa);
+
+    /**
+     * @param prefilter 可选。没有活跃的位置时用它跳到下一个可能的起点
+     */
+    explicit Glushkov(const NFA &nfa, const Prefilter *prefilter = nullptr);
+
+    /**
+     * 在text中寻找起点在[start, text.length())之中的匹配，返回最早结束的那个匹配的结束位置。
+     * 与PikeVM不同，这里不考虑优先级，因此只能用于判断是否存在匹配。
+     * @return 最早的结束位置；没有匹配时返回-1
+     */
+    int searchEarliest(std::string_view text, int start) const;
+
+    /**
+     * 占用的字节数
+     */
+    size_t byteSize() const { return sizeof(Glushkov) + follow.capacity() * sizeof(uint64_t); }
+
+private:
+    const Prefilter *prefilter;
+    int num_positions = 0;
+    bool empty_match = false; // 初态的epsilon闭包中是否有终态，即能否匹配空串
+    uint64_t first = 0; // 从初态出发（不消耗字符）可以到达的位置
+    uint64_t last = 0; // 到达后（不消耗字符）可以到达终态的位置
+    uint64_t linear = 0; // 第i+1位为1表示位置i之后可以紧跟位置i+1
+    uint64_t mask[256] = {}; // mask[c]为能够匹配字节c的位置
+    std::vector<uint64_t> follow; // follow[k*256+b]为第k组8个位置中，b所表示的那些位置之后可以跟随的其余位置
+};
+
+#endif //CPP_GLUSHKOV_H
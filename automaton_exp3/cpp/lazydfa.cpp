@@ -0,0 +1,310 @@
+#include "lazydfa.h"
+
+LazyDFA::LazyDFA(const NFA &nfa, int max_states, const Prefilter *prefilter, bool reverse)
+    : nfa(nfa), prefilter(prefilter), max_states(max_states), reverse(reverse)
+{
+    stride = nfa.num_classes + 1;
+    consumes.assign(nfa.num_states, false);
+    for(int i = 0; i < nfa.num_states; i++)
+        for(const Rule &r: nfa.rules[i])
+        {
+            if(r.guard & (ANCHOR_WORD | ANCHOR_NOT_WORD))
+                need_word = true;
+            if(r.guard & ANCHOR_BEGIN)
+                need_begin = true;
+            if(r.type != EPSILON)
+                consumes[i] = true;
+        }
+}
+
+size_t LazyDFA::byteSize() const
+{
+    return sizeof(LazyDFA) + consumes.capacity() / 8;
+}
+
+size_t LazyDFA::Cache::byteSize() const
+{
+    size_t size = sizeof(Cache);
+    size += states.capacity() * sizeof(DState) + table.capacity() * sizeof(int);
+    // ids中每个状态的键也保存了一份insts，另加上红黑树结点的开销（约4个指针）
+    for(auto &st: states)
+        size += 2 * st.insts.capacity() * sizeof(int) + sizeof(*ids.begin()) + 4 * sizeof(void*);
+    size += (stack.capacity() + closure.capacity() + mark.capacity() + seen.capacity()) * sizeof(int);
+    return size;
+}
+
+void LazyDFA::resetCache(Cache &cache) const
+{
+    cache.states.clear();
+    cache.ids.clear();
+    cache.table.clear();
+    if((int)cache.mark.size() != nfa.num_states)
+    {
+        cache.mark.assign(nfa.num_states, 0);
+        cache.seen.assign(nfa.num_states, 0);
+    }
+}
+
+int LazyDFA::addState(Cache &cache, const std::vector<int> &insts, int flags) const
+{
+    if(!need_word)
+        flags &= ~FLAG_WORD;
+    if(!need_begin)
+        flags &= ~FLAG_BEGIN;
+
+    auto key = std::make_pair(flags, insts);
+    auto it = cache.ids.find(key);
+    if(it != cache.ids.end())
+        return it->second;
+
+    int s = cache.states.size();
+    cache.states.push_back(Cache::DState{insts, flags});
+    cache.ids[key] = s;
+    cache.table.resize(cache.table.size() + stride, -1);
+    return s;
+}
+
+/**
+ * 搜索起点处的状态：还没有任何NFA状态，上下文标志由start前面的一个字符决定。
+ * 反向时“前面的一个字符”是start处的字符，并且唯一的起点（初态）一开始就在状态中
+*/
+int LazyDFA::startState(Cache &cache, std::string_view text, int start) const
+{
+    int flags = 0;
+    if(reverse)
+    {
+        int len = text.length();
+        if(start < len && w(text[start]))
+            flags |= FLAG_WORD;
+        if(start == len || (nfa.flag_m && text[start] == '\n'))
+            flags |= FLAG_BEGIN;
+        return addState(cache, {0}, flags);
+    }
+    if(start > 0 && w(text[start-1]))
+        flags |= FLAG_WORD;
+    if(start == 0 || (nfa.flag_m && text[start-1] == '\n'))
+        flags |= FLAG_BEGIN;
+    return addState(cache, {}, flags);
+}
+
+/**
+ * 计算状态s在字节c上的转移：
+ * 1. 若尚未找到匹配且c不是END，则在当前位置以最低优先级开启一个新的起点（NFA的初态0）；
+ * 2. 按优先级求epsilon闭包，anchor根据s的标志和c判断；
+ * 3. 闭包中的状态依优先级在c上转移，得到新状态的NFA状态列表。若途中到达终态（或经过一条进入终态的epsilon转移，
+ *    见PikeVM::consumes），则当前位置有一个匹配结束，优先级更低的状态全部丢弃。
+ * 反向时不开启新的起点，到达终态时也不丢弃其他状态（要找的是最靠左的起点，与优先级无关）。
+*/
+int LazyDFA::transition(Cache &cache, int s, int k) const
+{
+    // 同一等价类中的字节结果相同，用代表元计算
+    int c = k == nfa.num_classes ? END : nfa.class_rep[k];
+    std::vector<int> roots = cache.states[s].insts;
+    int flags = cache.states[s].flags;
+    std::vector<int> &stack = cache.stack, &closure = cache.closure, &mark = cache.mark, &seen = cache.seen;
+    if(!reverse && !(flags & FLAG_MATCHED) && c != END)
+        roots.push_back(0);
+
+    bool prev_word = flags & FLAG_WORD;
+    bool next_word = c != END && w((char)c);
+
+    // epsilon闭包，closure中按优先级从高到低记录访问到的状态；到达终态后更低优先级的状态都用不到了
+    bool begin = flags & FLAG_BEGIN;
+    int next = c == END ? -1 : c;
+    bool reached_final = false;
+    int mark_gen = ++cache.mark_gen;
+    closure.clear();
+    for(int root: roots)
+    {
+        stack.clear();
+        stack.push_back(root);
+        while(!stack.empty() && !(reached_final && !reverse))
+        {
+            int q = stack.back();
+            stack.pop_back();
+            if(mark[q] == mark_gen)
+                continue;
+            mark[q] = mark_gen;
+            closure.push_back(q);
+
+            if(nfa.is_final[q])
+            {
+                reached_final = true;
+                if(reverse)
+                    continue;
+                break;
+            }
+
+            for(const Rule &r: nfa.rules[q])
+            {
+                if(r.type != EPSILON || mark[r.dst] == mark_gen)
+                    continue;
+                if(consumes[q] && nfa.is_final[r.dst])
+                    continue;
+                if(guardHolds(r.guard, begin, prev_word, next, nfa.flag_m))
+                    stack.push_back(r.dst);
+            }
+        }
+        if(reached_final && !reverse)
+            break;
+    }
+
+    // 在c上转移
+    bool match_here = false;
+    std::vector<int> insts;
+    int seen_gen = ++cache.seen_gen;
+    for(int q: closure)
+    {
+        if(nfa.is_final[q])
+        {
+            match_here = true;
+            if(reverse)
+                continue;
+            break;
+        }
+        for(int k = nfa.rules[q].size() - 1; k >= 0 && !(match_here && !reverse); k--)
+        {
+            const Rule &r = nfa.rules[q][k];
+            if(r.type == EPSILON)
+            {
+                if(consumes[q] && nfa.is_final[r.dst] && guardHolds(r.guard, begin, prev_word, next, nfa.flag_m))
+                    match_here = true;
+                continue;
+            }
+            if(c == END || seen[r.dst] == seen_gen)
+                continue;
+            if(nfa.match(r, (char)c) && guardHolds(r.guard, begin, prev_word, next, nfa.flag_m))
+            {
+                seen[r.dst] = seen_gen;
+                insts.push_back(r.dst);
+            }
+        }
+        if(match_here && !reverse)
+            break;
+    }
+
+    int new_flags = flags & FLAG_MATCHED;
+    if(match_here)
+        new_flags |= reverse ? FLAG_MATCH_BEFORE : FLAG_MATCHED | FLAG_MATCH_BEFORE;
+    if(next_word)
+        new_flags |= FLAG_WORD;
+    if(nfa.flag_m && c == '\n')
+        new_flags |= FLAG_BEGIN;
+
+    int t = addState(cache, insts, new_flags);
+    cache.table[s * stride + k] = t;
+    return t;
+}
+
+int LazyDFA::step(Cache &cache, int s, int k) const
+{
+    int t = cache.table[s * stride + k];
+    if(t < 0)
+    {
+        if((int)cache.states.size() >= max_states)
+        {
+            if(cache.resets > 0 && cache.progress < 10LL * max_states)
+                return FAILED;
+            cache.resets++;
+            cache.progress = 0;
+
+            Cache::DState cur = cache.states[s];
+            resetCache(cache);
+            s = addState(cache, cur.insts, cur.flags);
+        }
+        t = transition(cache, s, k);
+    }
+    cache.progress++;
+    return t;
+}
+
+/**
+ * 在text中从start开始向后搜索第一个匹配，返回它的结束位置
+ * 每读入一个字节查一次表；进入带有FLAG_MATCH_BEFORE的状态说明读入该字节之前有一个匹配结束。
+ * 已经找到过匹配、且不再有存活的NFA状态时，后面不可能再有更优的结果，可以提前结束。
+ * 流式匹配时在text的结尾停下：没有存活的NFA状态、也没有找到过匹配的位置之前不可能有匹配开始，记为dead，
+ * 到达结尾时还有存活的状态则返回PARTIAL，匹配只能从dead开始
+*/
+int LazyDFA::searchEnd(std::string_view text, int start, Cache &cache, bool earliest, int *pending) const
+{
+    int len = text.length();
+    int last = -1;
+    if(cache.mark.empty())
+        resetCache(cache);
+    cache.resets = 0;
+    cache.progress = 0;
+
+    const std::vector<Cache::DState> &states = cache.states;
+    int s = startState(cache, text, start);
+    Prefilter::Cache pf_cache;
+    int dead = start;
+    for(int index = start; index <= len; index++)
+    {
+        if(pending)
+        {
+            bool idle = states[s].insts.empty() && !(states[s].flags & FLAG_MATCHED);
+            if(idle)
+                dead = index;
+            if(index == len)
+            {
+                *pending = idle ? len : dead;
+                return idle ? -1 : PARTIAL;
+            }
+        }
+        // 还没有找到匹配、也没有存活的NFA状态时，直接跳到下一个可能的起点
+        else if(prefilter && index < len && states[s].insts.empty() && !(states[s].flags & FLAG_MATCHED))
+        {
+            int next = prefilter->next(text, index, pf_cache);
+            if(next < 0)
+                break;
+            if(next > index)
+            {
+                index = next;
+                s = startState(cache, text, index);
+            }
+        }
+        int k = index < len ? nfa.classes[(unsigned char)text[index]] : nfa.num_classes;
+        if((s = step(cache, s, k)) == FAILED)
+            return FAILED;
+
+        if(states[s].flags & FLAG_MATCH_BEFORE)
+        {
+            last = index;
+            if(earliest)
+                return last;
+        }
+        if(states[s].insts.empty() && (states[s].flags & FLAG_MATCHED))
+            break;
+    }
+
+    return last;
+}
+
+/**
+ * 从end开始向左逐个读入字节（位置0的左边读入END），进入带有FLAG_MATCH_BEFORE的状态说明当前位置是一个可能的起点。
+ * 没有存活的NFA状态时，更靠左的位置都不可能了
+*/
+int LazyDFA::searchStart(std::string_view text, int end, int min_start, Cache &cache) const
+{
+    int last = -1;
+    if(cache.mark.empty())
+        resetCache(cache);
+    cache.resets = 0;
+    cache.progress = 0;
+
+    const std::vector<Cache::DState> &states = cache.states;
+    int s = startState(cache, text, end);
+    for(int index = end; index >= min_start; index--)
+    {
+        int k = index > 0 ? nfa.classes[(unsigned char)text[index-1]] : nfa.num_classes;
+        if((s = step(cache, s, k)) == FAILED)
+            return FAILED;
+
+        if(states[s].flags & FLAG_MATCH_BEFORE)
+            last = index;
+        if(states[s].insts.empty())
+            break;
+    }
+
+    return last;
+}
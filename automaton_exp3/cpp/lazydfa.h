@@ -0,0 +1,132 @@
+#ifndef CPP_LAZYDFA_H
+#define CPP_LAZYDFA_H
+
+#include <map>
+#include "nfa.h"
+#include "prefilter.h"
+
+/**
+ * 惰性（在线）构造的DFA，只回答“是否匹配、匹配在哪里结束”，不记录捕获分组。
+ * 每个DFA状态是一组有序的NFA状态（顺序即优先级，与PikeVM的线程顺序一致），外加少量上下文标志，
+ * 在搜索过程中按需构造，并缓存每个状态在每个字节上的转移，之后同样的转移只需查一次表。
+ * anchor（^ $ \b \B）在计算转移时处理：DFA状态中记录前一个字符的信息，转移时已知下一个字符，
+ * 因此在转移的那一刻就能判断anchor是否成立，不需要退回NFA。文本结尾作为一个额外的字节END参与转移。
+ * 转移表的列是NFA的字节等价类（NFA::classes），最后一列为END，因此每个状态只占num_classes+1个表项。
+ * 缓存的状态数有上限，超过时清空缓存重来；若清空得过于频繁，则放弃并由调用者改用NFA引擎。
+ * LazyDFA对象本身在构造之后只读，缓存放在调用者提供的Cache中，因此多个线程可以各用一个Cache共享同一个LazyDFA。
+ * 在反向NFA（见NFA::reverse）上构造时，从右往左读入文本，只从一个位置开始，并且到达终态后不丢弃其他状态，用于求匹配的起点（searchStart）。
+ */
+class LazyDFA {
+public:
+    static const int END = 256; // 表示文本结尾的虚拟字节
+    static const int FAILED = -2; // searchEnd的返回值，表示缓存失效，需要改用NFA引擎
+    static const int PARTIAL = -3; // searchEnd的返回值，表示text之后的输入可能改变结果，见pending参数
+
+    /**
+     * @param nfa 要执行的NFA，需在LazyDFA的生命周期内保持不变，不能带计数器
+     * @param max_states 缓存中最多保存的DFA状态数
+     * @param prefilter 可选。没有存活的NFA状态时用它跳到下一个可能的起点
+     * @param reverse nfa是否为反向NFA
+     */
+    explicit LazyDFA(const NFA &nfa, int max_states = 4096, const Prefilter *prefilter = nullptr, bool reverse = false);
+
+    /**
+     * 按需构造的DFA状态和转移表，以及计算转移时使用的临时空间。一个Cache只能用于构造它的那一个LazyDFA，同一时刻只能被一个线程使用
+     */
+    class Cache {
+    public:
+        /**
+         * 估计当前占用的字节数（缓存的状态和转移表会随着搜索增长，最多max_states个状态）
+         */
+        size_t byteSize() const;
+
+    private:
+        friend class LazyDFA;
+
+        struct DState {
+            std::vector<int> insts; // 尚未求epsilon闭包的NFA状态，按优先级从高到低排列
+            int flags;
+        };
+
+        std::vector<DState> states;
+        std::map<std::pair<int, std::vector<int>>, int> ids; // (flags, insts) -> 状态编号
+        std::vector<int> table; // table[s*stride+k]为状态s在等价类k上的转移，-1表示尚未计算
+
+        // transition中使用的临时空间
+        std::vector<int> stack;
+        std::vector<int> closure;
+        std::vector<int> mark; // mark[q]==mark_gen表示q已在本次的闭包中
+        int mark_gen = 0;
+        std::vector<int> seen; // seen[q]==seen_gen表示q已在新状态的列表中
+        int seen_gen = 0;
+
+        // 缓存被清空时，若距离上次清空处理的字节数太少，说明缓存在频繁地抖动，DFA已经没有优势。每次搜索开始时清零
+        int resets = 0;
+        long long progress = 0;
+    };
+
+    /**
+     * 在text中从start开始向后搜索第一个匹配（语义同PikeVM::exec，匹配的起点只会在[start, text.length())之中），返回它的结束位置。
+     * @param earliest 为true时只要发现有匹配就立即返回，此时返回的结束位置不一定是该匹配真正的结束位置
+     * @param pending 不为空时，text只是输入的一部分（流式匹配，见StreamMatcher），后面还有输入：不读入END，也不使用预过滤。
+     *        结果依赖于后面的输入时返回PARTIAL，此时*pending为尚未确定的匹配的最早可能起点；返回-1时*pending为text的长度
+     * @return 匹配的结束位置；没有匹配时返回-1；缓存失效时返回FAILED；见pending
+     */
+    int searchEnd(std::string_view text, int start, Cache &cache, bool earliest = false, int *pending = nullptr) const;
+
+    /**
+     * 仅用于反向NFA。从end开始向左读入，求最小的s（min_start <= s <= end），使得text[s, end)能被原来的正则表达式匹配。
+     * 已知某个匹配在end结束、且min_start之后最靠左的匹配起点在s时，它就是这个匹配的起点
+     * @return s；不存在时返回-1；缓存失效时返回FAILED
+     */
+    int searchStart(std::string_view text, int end, int min_start, Cache &cache) const;
+
+    /**
+     * 占用的字节数，不包括Cache
+     */
+    size_t byteSize() const;
+
+private:
+    /**
+     * DFA状态的标志位
+     */
+    enum {
+        FLAG_WORD = 1, // 前一个字符是单词字符（用于\b \B）
+        FLAG_BEGIN = 2, // 当前位置满足^（文本开头，或m修饰符下前一个字符是换行）
+        FLAG_MATCHED = 4, // 此前已经找到过匹配，不再开启新的起点
+        FLAG_MATCH_BEFORE = 8, // 进入本状态的转移之前的位置恰好有一个匹配结束
+    };
+
+    int startState(Cache &cache, std::string_view text, int start) const;
+
+    /**
+     * 查表得到状态s在等价类k上的转移，未缓存时计算。缓存满时清空，清空得过于频繁时返回FAILED
+     */
+    int step(Cache &cache, int s, int k) const;
+
+    /**
+     * 查找或新建一个DFA状态，返回它的编号
+     */
+    int addState(Cache &cache, const std::vector<int> &insts, int flags) const;
+
+    /**
+     * 计算状态s在等价类k（k==num_classes表示END）上的转移，并写入缓存
+     */
+    int transition(Cache &cache, int s, int k) const;
+
+    /**
+     * 清空缓存的状态；第一次使用时分配临时空间
+     */
+    void resetCache(Cache &cache) const;
+
+    const NFA &nfa;
+    const Prefilter *prefilter;
+    int max_states;
+    bool reverse;
+    bool need_word = false; // NFA中是否有\b \B
+    bool need_begin = false; // NFA中是否有^
+    std::vector<bool> consumes; // consumes[q]表示状态q是否有非epsilon转移
+    int stride; // 转移表每行的长度，即等价类的个数加一
+};
+
+#endif //CPP_LAZYDFA_H
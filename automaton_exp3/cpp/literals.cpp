@@ -0,0 +1,398 @@
+#include "literals.h"
+#include <algorithm>
+#include <cstring>
+
+/**
+ * 两个长度的和，-1表示无界
+*/
+static int addLength(int a, int b)
+{
+    if(a < 0 || b < 0)
+        return -1;
+    return std::min(a + b, 1 << 29);
+}
+
+/**
+ * 两组串的笛卡尔积，超出LiteralInfo的限制时返回false
+*/
+static bool product(const std::vector<std::string> &a, const std::vector<std::string> &b, std::vector<std::string> &result)
+{
+    if(a.size() * b.size() > LiteralInfo::MAX_STRINGS)
+        return false;
+    result.clear();
+    for(auto &x: a)
+        for(auto &y: b)
+        {
+            if(x.size() + y.size() > LiteralInfo::MAX_LENGTH)
+                return false;
+            result.push_back(x + y);
+        }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return true;
+}
+
+/**
+ * 判断必需字面量a是否比b更好：最短的串越长越好，其次串越少越好，最后before有界更好
+*/
+static bool better(const LiteralInfo &a, const LiteralInfo &b)
+{
+    if(a.strings.empty())
+        return false;
+    if(b.strings.empty())
+        return true;
+    size_t la = a.strings[0].size(), lb = b.strings[0].size();
+    for(auto &s: a.strings)
+        la = std::min(la, s.size());
+    for(auto &s: b.strings)
+        lb = std::min(lb, s.size());
+    if(la != lb)
+        return la > lb;
+    if(a.strings.size() != b.strings.size())
+        return a.strings.size() < b.strings.size();
+    return a.before >= 0 && b.before < 0;
+}
+
+/**
+ * 子结点的结果用完即移出，同一时刻只保留尚未被父结点使用的那些
+*/
+LiteralInfo LiteralInfo::analyze(const RegexAST &ast)
+{
+    std::vector<LiteralInfo> info(ast.nodes.size());
+    std::vector<LiteralInfo> children;
+    for(int n: ast.postorder())
+    {
+        const RegexNode &node = ast.nodes[n];
+        children.clear();
+        for(int c = node.child; c >= 0; c = ast.nodes[c].next)
+            children.push_back(std::move(info[c]));
+
+        LiteralInfo item;
+        if(node.type == NODE_ALTERNATION)
+            item = alternation(children);
+        else if(node.type == NODE_CONCAT)
+            item = sequence(children);
+        else if(node.type == NODE_ANCHOR)
+            item = anchor();
+        else
+            item = node.type == NODE_SET ? single(ast.sets[node.value]) : children[0];
+
+        if(node.quantifier == QUANT_RANGE)
+            item = repeat(item, node.min, node.max);
+        else if(node.quantifier == QUANT_ZERO_OR_ONE)
+            item = repeat(item, 0, 1);
+        else if(node.quantifier == QUANT_ZERO_OR_MORE)
+            item = repeat(item, 0, -1);
+        else if(node.quantifier == QUANT_ONE_OR_MORE)
+            item = repeat(item, 1, -1);
+        info[n] = std::move(item);
+    }
+    return info[ast.root];
+}
+
+LiteralInfo LiteralInfo::single(const ByteSet &set)
+{
+    LiteralInfo info;
+    info.min_len = info.max_len = 1;
+    std::vector<std::string> bytes;
+    for(int c = 0; c < 256 && (int)bytes.size() <= MAX_CLASS; c++)
+        if(set.test(c))
+            bytes.push_back(std::string(1, (char)c));
+    if(!bytes.empty() && (int)bytes.size() <= MAX_CLASS)
+    {
+        info.exact = true;
+        info.strings = bytes;
+    }
+    return info;
+}
+
+LiteralInfo LiteralInfo::anchor()
+{
+    LiteralInfo info;
+    info.exact = true;
+    info.strings.push_back("");
+    return info;
+}
+
+LiteralInfo LiteralInfo::required() const
+{
+    LiteralInfo info = *this;
+    if(exact)
+    {
+        info.exact = false;
+        info.before = 0;
+        for(auto &s: strings)
+            if(s.empty())
+                info.strings.clear();
+    }
+    return info;
+}
+
+/**
+ * 从左到右扫描，offset为当前子表达式之前所有子表达式的最大长度之和。
+ * run为当前连续的精确子表达式的笛卡尔积，遇到非精确的子表达式或积太大时，run作为一个候选结束
+*/
+LiteralInfo LiteralInfo::sequence(const std::vector<LiteralInfo> &items)
+{
+    LiteralInfo result;
+    if(items.empty())
+        return anchor();
+
+    LiteralInfo best;
+    std::vector<std::string> run, tmp;
+    bool in_run = false, all_exact = true;
+    int offset = 0, run_offset = 0;
+
+    auto flush = [&]() {
+        if(!in_run)
+            return;
+        LiteralInfo candidate;
+        candidate.exact = true;
+        candidate.strings = run;
+        candidate = candidate.required();
+        candidate.before = run_offset;
+        if(better(candidate, best))
+            best = candidate;
+        in_run = false;
+    };
+
+    for(const LiteralInfo &item: items)
+    {
+        if(item.exact)
+        {
+            if(in_run && product(run, item.strings, tmp))
+                run.swap(tmp);
+            else
+            {
+                if(in_run)
+                    all_exact = false;
+                flush();
+                run = item.strings;
+                run_offset = offset;
+                in_run = true;
+            }
+        }
+        else
+        {
+            all_exact = false;
+            flush();
+            LiteralInfo candidate = item.required();
+            candidate.before = addLength(offset, candidate.before);
+            if(better(candidate, best))
+                best = candidate;
+        }
+        offset = addLength(offset, item.max_len);
+        result.min_len = std::min(result.min_len + item.min_len, 1 << 29);
+    }
+
+    if(all_exact)
+    {
+        result.exact = true;
+        result.strings = run;
+    }
+    else
+    {
+        flush();
+        result.strings = best.strings;
+        result.before = best.before;
+    }
+    result.max_len = offset;
+    return result;
+}
+
+LiteralInfo LiteralInfo::alternation(const std::vector<LiteralInfo> &branches)
+{
+    if(branches.size() == 1)
+        return branches[0];
+
+    LiteralInfo result;
+    result.min_len = branches[0].min_len;
+    result.max_len = branches[0].max_len;
+    bool all_exact = true;
+    for(const LiteralInfo &b: branches)
+    {
+        result.min_len = std::min(result.min_len, b.min_len);
+        result.max_len = (result.max_len < 0 || b.max_len < 0) ? -1 : std::max(result.max_len, b.max_len);
+        all_exact = all_exact && b.exact;
+    }
+
+    std::vector<std::string> strings;
+    int before = 0;
+    for(const LiteralInfo &b: branches)
+    {
+        LiteralInfo r = all_exact ? b : b.required();
+        if(!all_exact && r.strings.empty())
+            return result;
+        strings.insert(strings.end(), r.strings.begin(), r.strings.end());
+        before = (before < 0 || r.before < 0) ? -1 : std::max(before, r.before);
+    }
+    std::sort(strings.begin(), strings.end());
+    strings.erase(std::unique(strings.begin(), strings.end()), strings.end());
+    if((int)strings.size() > MAX_STRINGS)
+        return result;
+
+    result.exact = all_exact;
+    result.strings = strings;
+    result.before = all_exact ? -1 : before;
+    return result;
+}
+
+LiteralInfo LiteralInfo::repeat(const LiteralInfo &item, int min, int max)
+{
+    LiteralInfo result;
+    result.min_len = (int)std::min((long long)item.min_len * min, 1LL << 29);
+    if(item.max_len == 0 || max == 0)
+        result.max_len = 0;
+    else if(item.max_len < 0 || max < 0)
+        result.max_len = -1;
+    else
+        result.max_len = (int)std::min((long long)item.max_len * max, 1LL << 29);
+
+    // 精确的集合：重复min到max次的所有结果之并
+    if(item.exact && max >= 0 && max <= MAX_LENGTH)
+    {
+        std::vector<std::string> power{""}, all, tmp;
+        bool ok = true;
+        for(int k = 0; k <= max && ok; k++)
+        {
+            if(k >= min)
+                all.insert(all.end(), power.begin(), power.end());
+            if(k < max)
+            {
+                ok = product(power, item.strings, tmp);
+                power.swap(tmp);
+            }
+        }
+        std::sort(all.begin(), all.end());
+        all.erase(std::unique(all.begin(), all.end()), all.end());
+        if(ok && (int)all.size() <= MAX_STRINGS)
+        {
+            result.exact = true;
+            result.strings = all;
+            return result;
+        }
+    }
+
+    // 至少出现一次时，第一次出现的必需字面量也是整体的必需字面量
+    if(min >= 1)
+    {
+        LiteralInfo r = item.required();
+        result.strings = r.strings;
+        result.before = r.before;
+    }
+    return result;
+}
+
+/**
+ * 字节在一般文本（日志等）中的常见程度，越小越常见。未列出的字节视为罕见
+*/
+static int commonness(unsigned char c)
+{
+    static const char common[] = " etaoinsrhldcumfpgwybv0123456789.,-_/:=kxjqzETAOINSRHLDCUMFPGWYBVKXJQZ\"'()[]\t\n";
+    const char *p = strchr(common, c);
+    if(c == 0 || p == nullptr)
+        return 1000;
+    return (int)(sizeof(common) - (p - common));
+}
+
+LiteralSearcher::LiteralSearcher(const std::vector<std::string> &strings) : strings(strings)
+{
+    for(auto &s: strings)
+        max_length = std::max(max_length, (int)s.size());
+
+    if(strings.size() == 1)
+    {
+        // commonness越小越罕见
+        const std::string &s = strings[0];
+        for(int i = 1; i < (int)s.size(); i++)
+            if(commonness(s[i]) < commonness(s[rare]))
+                rare = i;
+        return;
+    }
+    if(strings.empty())
+        return;
+
+    // 字面量中出现的每个字节单独成为一类，其余字节都是第0类
+    for(auto &s: strings)
+        for(unsigned char c: s)
+            if(classes[c] == 0)
+                classes[c] = num_classes++;
+
+    // 先建字典树，再按广度优先的顺序补全转移（失败时沿fail链转移）
+    goto_table.assign(num_classes, -1);
+    output.assign(1, false);
+    for(auto &s: strings)
+    {
+        int q = 0;
+        for(unsigned char c: s)
+        {
+            int &t = goto_table[q * num_classes + classes[c]];
+            if(t < 0)
+            {
+                t = output.size();
+                output.push_back(false);
+                goto_table.resize(goto_table.size() + num_classes, -1);
+            }
+            q = goto_table[q * num_classes + classes[c]];
+        }
+        output[q] = true;
+    }
+
+    std::vector<int> fail(output.size(), 0), queue;
+    for(int k = 0; k < num_classes; k++)
+    {
+        int &t = goto_table[k];
+        if(t < 0)
+            t = 0;
+        else
+            queue.push_back(t);
+    }
+    for(int i = 0; i < (int)queue.size(); i++)
+    {
+        int q = queue[i];
+        output[q] = output[q] || output[fail[q]];
+        for(int k = 0; k < num_classes; k++)
+        {
+            int &t = goto_table[q * num_classes + k];
+            if(t < 0)
+                t = goto_table[fail[q] * num_classes + k];
+            else
+            {
+                fail[t] = goto_table[fail[q] * num_classes + k];
+                queue.push_back(t);
+            }
+        }
+    }
+}
+
+int LiteralSearcher::find(std::string_view text, int from) const
+{
+    int len = text.length();
+    const char *data = text.data();
+    if(strings.size() == 1)
+    {
+        const std::string &s = strings[0];
+        int n = s.size();
+        for(int pos = from + rare; pos < len; )
+        {
+            const char *p = (const char *)memchr(data + pos, s[rare], len - pos);
+            if(p == nullptr)
+                return -1;
+            int start = (p - data) - rare;
+            if(start + n <= len && memcmp(data + start, s.data(), n) == 0)
+                return start;
+            pos = (p - data) + 1;
+        }
+        return -1;
+    }
+
+    // 最早结束的出现位置为e时，任何起点不小于from的出现都不早于e-max_length开始
+    int q = 0;
+    for(int i = from; i < len; i++)
+    {
+        q = goto_table[q * num_classes + classes[(unsigned char)data[i]]];
+        if(output[q])
+            return std::max(from, i + 1 - max_length);
+    }
+    return -1;
+}
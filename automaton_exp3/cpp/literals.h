@@ -0,0 +1,95 @@
+#ifndef CPP_LITERALS_H
+#define CPP_LITERALS_H
+
+#include <string>
+#include <vector>
+#include "nfa.h"
+#include "ast.h"
+
+/**
+ * 正则表达式（或其中一个子表达式）的字面量信息，由analyze在抽象语法树上自底向上地计算。
+ * exact为true时，子表达式能匹配的串恰好是strings中的这些串（例如 (ERROR|FATAL): 对应 {"ERROR:", "FATAL:"}）；
+ * 否则strings是一组“必需字面量”：每个匹配都至少包含其中一个，并且它出现的位置距匹配起点不超过before。
+ */
+struct LiteralInfo {
+    static const int MAX_STRINGS = 32; // strings的最大个数，超过时放弃精确的集合
+    static const int MAX_LENGTH = 32; // strings中串的最大长度
+    static const int MAX_CLASS = 4; // 字节集合不超过这么多个字节时（如[Ee]）仍视为精确的字面量
+
+    bool exact = false;
+    std::vector<std::string> strings; // 为空表示没有必需字面量
+    int before = -1; // exact为false时，必需字面量的起点距匹配起点的最大距离，-1表示无界
+    int min_len = 0; // 匹配的最小长度
+    int max_len = 0; // 匹配的最大长度，-1表示无界
+
+    /**
+     * 按后序计算抽象语法树中每个结点的字面量信息，返回根结点的
+     */
+    static LiteralInfo analyze(const RegexAST &ast);
+
+    /**
+     * 单个字符、字符类或字符组，set为它能匹配的字节
+     */
+    static LiteralInfo single(const ByteSet &set);
+
+    /**
+     * anchor，只匹配空串
+     */
+    static LiteralInfo anchor();
+
+    /**
+     * 依次连接items中的各个子表达式。相邻的精确子表达式先做笛卡尔积（\d+ms 中的"ms"），
+     * 再从所有候选中选出最好的一组必需字面量
+     */
+    static LiteralInfo sequence(const std::vector<LiteralInfo> &items);
+
+    /**
+     * 多个分支的选择。每个分支都有必需字面量时，它们的并才是整体的必需字面量
+     */
+    static LiteralInfo alternation(const std::vector<LiteralInfo> &branches);
+
+    /**
+     * 将item重复[min, max]次，max为-1表示无界
+     */
+    static LiteralInfo repeat(const LiteralInfo &item, int min, int max);
+
+    /**
+     * 转为必需字面量的形式：精确的集合本身就是必需字面量，出现在匹配的起点。含有空串时没有必需字面量
+     */
+    LiteralInfo required() const;
+};
+
+/**
+ * 在文本中寻找一组字面量的出现位置。
+ * 只有一个字面量时，选其中最罕见的字节用memchr定位，再比较整个字面量；
+ * 有多个字面量时，使用Aho–Corasick自动机，转移表按字面量中出现的字节压缩为等价类。
+ */
+class LiteralSearcher {
+public:
+    LiteralSearcher() = default;
+
+    explicit LiteralSearcher(const std::vector<std::string> &strings);
+
+    bool empty() const { return strings.empty(); }
+
+    /**
+     * 寻找起点不小于from的字面量出现位置
+     * @return 不大于最早出现位置、且不小于from的一个位置（多个字面量时为下界）；没有出现时返回-1
+     */
+    int find(std::string_view text, int from) const;
+
+private:
+    std::vector<std::string> strings;
+    int max_length = 0;
+
+    // 单个字面量：rare为最罕见的字节在字面量中的下标
+    int rare = 0;
+
+    // Aho–Corasick：classes[c]为字节c的类（0表示不在任何字面量中），goto_table[s*num_classes+k]为状态s读入类k后的状态
+    unsigned char classes[256] = {};
+    int num_classes = 1;
+    std::vector<int> goto_table;
+    std::vector<bool> output; // output[s]表示状态s的某个后缀是一个字面量
+};
+
+#endif //CPP_LITERALS_H
@@ -1,12 +1,18 @@
 #include <iostream>
-#include <sstream>
+#include <memory>
+#include <cstring>
 #include "nfa.h"
+#include "dfa.h"
+#include "mappedfile.h"
+#include "utils.h"
 
 /**
  * 本程序支持两种运行方式：
  * 1、将输入文件的文件名作为唯一的命令行参数传入。
  *    例如: ./nfa ../cases/01.txt
  * 2、若不传入任何参数，则程序将从stdin中读取输入。
+ * 在文件名之前加上--dfa参数时（例如: ./nfa --dfa ../cases/01.txt），先将NFA转换为最小化的DFA再执行，
+ * 此时判断的是整个输入串能否被接受，输出Accept或Reject。
  */
 
 /**
@@ -14,28 +20,30 @@
  * 一般来说，你不需要阅读和改动这里的代码，只需要完成exec函数即可。
  */
 int main(int argc, char* argv[]) {
-    FILE* f;
-    if (argc >= 2) {
-        f = fopen(argv[1], "r");
-        if (!f) throw std::system_error(errno, std::generic_category());
-    } else f = stdin;
+    bool use_dfa = false;
+    if (argc >= 2 && strcmp(argv[1], "--dfa") == 0) {
+        use_dfa = true;
+        argv++;
+        argc--;
+    }
 
-    std::string text;
-    const int BUFSIZE = 4096;
-    char buf[BUFSIZE+1];
-    size_t n;
-    do {
-        n = fread(buf, 1, BUFSIZE, f);
-        buf[n] = 0;
-        text += buf;
-    } while (n == BUFSIZE);
-    if (!feof(f)) throw std::system_error(errno, std::generic_category());
+    // 文件直接映射到内存，stdin则读入一次；输入串只引用其中的一段，不再复制
+    std::unique_ptr<MappedFile> file;
+    std::string stdin_text;
+    std::string_view text;
+    if (argc >= 2) {
+        file.reset(new MappedFile(argv[1]));
+        text = std::string_view(file->data(), file->size());
+    } else {
+        stdin_text = readAll(stdin);
+        text = stdin_text;
+    }
 
-    std::string input_str;
+    std::string_view input_str;
     bool input_str_found = false;
-    std::istringstream ss(text);
-    std::string line;
-    while (std::getline(ss, line)) {
+    std::string_view line;
+    size_t pos = 0;
+    while (nextLine(text, pos, line)) {
         if (line.find("input: ") == 0) {
             input_str = line.substr(7);
             input_str_found = true;
@@ -44,6 +52,13 @@ int main(int argc, char* argv[]) {
     if (!input_str_found) throw std::runtime_error("未找到输入字符串！注意输入字符串必须以input: 开头，其中冒号后面必须有空格！");
 
     NFA nfa = NFA::from_text(text);
+    nfa.removeEpsilon(true);
+    if (use_dfa) {
+        DFA dfa = DFA::from_nfa(nfa);
+        dfa.minimize();
+        std::cout << (dfa.exec(input_str, 0) ? "Accept" : "Reject");
+        return 0;
+    }
     Path result = nfa.exec(input_str);
     std::cout << result;
 
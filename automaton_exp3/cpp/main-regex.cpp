@@ -1,6 +1,8 @@
 #include "regex.h"
 #include "lib/json.hpp"
 #include "utils.h"
+#include "mappedfile.h"
+#include <memory>
 
 /**
  * 本程序支持两种运行方式：
@@ -14,30 +16,25 @@
  * 一般来说，你不需要阅读和改动这里的代码，只需要完成上面Regex类中的标有TODO的函数即可。
  */
 int main(int argc, char *argv[]) {
-    FILE *f;
+    // 文件直接映射到内存，stdin则读入一次；之后的解析和匹配都只引用这一份数据，不再复制
+    std::unique_ptr<MappedFile> file;
+    std::string stdin_text;
+    std::string_view text;
     if (argc >= 2) {
-        f = fopen(argv[1], "rb");
-        if (!f) throw std::system_error(errno, std::generic_category());
-    } else f = stdin;
+        file.reset(new MappedFile(argv[1]));
+        text = std::string_view(file->data(), file->size());
+    } else {
+        stdin_text = readAll(stdin);
+        text = stdin_text;
+    }
     setStdoutToBinary();
 
-    std::string text;
-    const int BUFSIZE = 4096;
-    char buf[BUFSIZE + 1];
-    size_t n;
-    do {
-        n = fread(buf, 1, BUFSIZE, f);
-        buf[n] = 0;
-        text += buf;
-    } while (n == BUFSIZE);
-    if (!feof(f)) throw std::system_error(errno, std::generic_category());
-
-    std::string type, pattern, flags, input_str, replacement;
+    std::string type, pattern, flags, replacement;
+    std::string_view input_str;
     bool pattern_found = false, input_str_found = false, replacement_found = false;
-    std::istringstream ss(text);
-    std::string line;
-    size_t lenBeforeInputLine = 0;
-    while (std::getline(ss, line)) {
+    std::string_view line;
+    size_t pos = 0, lenBeforeInputLine = 0;
+    while (nextLine(text, pos, line)) {
         if (line.find("type:") == 0) {
             type = strip(line.substr(5));
         } else if (line.find("pattern: ") == 0) {
@@ -52,7 +49,7 @@ int main(int argc, char *argv[]) {
             input_str = text.substr(lenBeforeInputLine + 7);
             input_str_found = true;
         }
-        lenBeforeInputLine += line.size() + 1;
+        lenBeforeInputLine = pos;
     }
     if (!pattern_found || !input_str_found)
         throw std::runtime_error("pattern或input未找到！注意pattern: 和input: ，冒号后面必须有空格！");
@@ -62,12 +59,15 @@ int main(int argc, char *argv[]) {
     if (type == "find" || type == "match") {
         std::vector<std::string> result = regex.match(input_str);
         std::cout << nlohmann::json(result) << std::endl;
+    } else if (type == "test") {
+        bool result = regex.test(input_str);
+        std::cout << nlohmann::json(result) << std::endl;
     } else if (type == "matchAll") {
-        std::vector<std::vector<std::string>> result = regex.matchAll(input_str);
+        std::vector<std::vector<std::string>> result = regex.matchAll(input_str, 0);
         std::cout << nlohmann::json(result) << std::endl;
     } else if (type == "replaceAll") {
         if (!replacement_found) throw std::runtime_error("type=replaceAll的输入，但是未找到replacement字段！");
-        std::string result = regex.replaceAll(input_str, replacement);
+        std::string result = regex.replaceAll(input_str, replacement, 0);
         std::cout << result;
     } else {
         throw std::runtime_error("不支持的输入文件类型！");
@@ -0,0 +1,85 @@
+#include "mappedfile.h"
+#include "utils.h"
+#include <cerrno>
+#include <system_error>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPPEDFILE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+void MappedFile::readFrom(FILE *f, const std::string &path)
+{
+    try {
+        buffer = readAll(f);
+    } catch(const std::system_error &e) {
+        fclose(f);
+        throw std::system_error(e.code(), path);
+    }
+    fclose(f);
+    addr = buffer.data();
+    length = buffer.size();
+}
+
+#ifdef MAPPEDFILE_MMAP
+/**
+ * st_size只对普通文件有意义，管道、/proc下的文件等报告的大小为0，需要通过文件描述符读到结尾
+*/
+MappedFile::MappedFile(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::system_error(errno, std::generic_category(), path);
+    struct stat st;
+    if(fstat(fd, &st) < 0)
+    {
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(), path);
+    }
+    if(!S_ISREG(st.st_mode) || st.st_size <= 0)
+    {
+        FILE *f = fdopen(fd, "rb");
+        if(!f)
+        {
+            int err = errno;
+            close(fd);
+            throw std::system_error(err, std::generic_category(), path);
+        }
+        readFrom(f, path); // 同时关闭fd
+        return;
+    }
+    length = st.st_size;
+    void *p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    if(p == MAP_FAILED)
+    {
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(), path);
+    }
+    addr = static_cast<const char*>(p);
+    mapped = true;
+    close(fd); // 映射在关闭文件之后仍然有效
+}
+
+MappedFile::~MappedFile()
+{
+    if(mapped)
+        munmap(const_cast<char*>(addr), length);
+}
+#else
+MappedFile::MappedFile(const std::string &path)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if(!f)
+        throw std::system_error(errno, std::generic_category(), path);
+    readFrom(f, path);
+}
+
+MappedFile::~MappedFile()
+{
+}
+#endif
@@ -0,0 +1,37 @@
+#ifndef CPP_MAPPEDFILE_H
+#define CPP_MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+#include <cstdio>
+
+/**
+ * 以只读方式映射到内存中的整个文件。POSIX系统上对非空的普通文件使用mmap（MAP_SHARED），多个进程映射同一个文件时共享物理页，
+ * 读入的代价只是缺页；管道、FIFO、/dev/stdin、/proc下的文件等大小未知的文件，以及其他系统上，退回到把整个文件读入内存。
+ * 打开或读取失败时抛出std::system_error。
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path);
+
+    MappedFile(const MappedFile &) = delete;
+
+    ~MappedFile();
+
+    const char *data() const { return addr; }
+
+    size_t size() const { return length; }
+
+private:
+    /**
+     * 不能映射时，从f读入全部内容到buffer
+     */
+    void readFrom(FILE *f, const std::string &path);
+
+    const char *addr = nullptr;
+    size_t length = 0;
+    bool mapped = false; // 为true表示addr由mmap得到，否则指向buffer
+    std::string buffer;
+};
+
+#endif //CPP_MAPPEDFILE_H
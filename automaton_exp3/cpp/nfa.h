@@ -2,10 +2,13 @@
 #define CPP_NFA_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iostream>
 
 #include <set>
+#include <unordered_set>
+#include <cstdint>
 
 /**
  * 本文件（包括对应的cpp文件）中已经定义好了一些类和函数，类内也已经定义好了一些成员变量和方法。不建议大家修改这些已经定义好的东西。
@@ -32,20 +35,75 @@ enum RuleType {
 };
 
 /**
- * 表示一条状态转移规则。
+ * anchor条件的位掩码。消去epsilon转移之后，原来路径上的anchor作为条件附加在转移上（Rule::guard），多个条件需要同时成立
  */
-struct Rule {
-    int dst; // 目的状态
-    RuleType type; // 状态转移的类型，取值见上方的宏定义
-    std::string by; // 对特殊字符转移，这里只有一个字母，如d；对字符区间转移，这里是区间的开头，如a；对一般转移，这里就是转移所需的字母；对epsilon-转移，这里固定为空串。
-    std::string to; // 对字符区间转移，这里是区间的结尾，如z；对任何其他类型的转移，这里固定为空串。
+enum AnchorFlag {
+    ANCHOR_BEGIN = 1, // ^
+    ANCHOR_END = 2, // $
+    ANCHOR_WORD = 4, // \b
+    ANCHOR_NOT_WORD = 8, // \B
+};
+
+/**
+ * 计数器操作，见Rule::ops。计数器的值为当前这次重复之前已经完成的次数
+ */
+enum CounterOp {
+    COUNTER_RESET = 0, // 进入第一次重复：置为0
+    COUNTER_LOOP = 1, // 完成一次重复并开始下一次：要求完成后的次数小于上界，加一
+    COUNTER_EXIT = 2, // 完成一次重复并离开：要求完成后的次数不小于下界，置为0
+};
+
+/**
+ * {m,n}的一个计数器（见NFABuilder::counted），max为-1表示无界
+ */
+struct Counter {
+    int min, max;
+};
+
+/**
+ * 256位的字节集合，表示一条非epsilon转移能够匹配的所有字节。判断一个字节是否在集合中只需一次移位，
+ * 也不区分char的符号，0x80以上的字节同样可以使用。
+ */
+struct ByteSet {
+    uint64_t bits[4] = {};
+
+    bool test(unsigned char c) const { return bits[c >> 6] >> (c & 63) & 1; }
+    void set(unsigned char c) { bits[c >> 6] |= 1ULL << (c & 63); }
+
+    /**
+     * 加入[lo, hi]中的所有字节
+     */
+    void setRange(unsigned char lo, unsigned char hi);
+
+    /**
+     * 取补集
+     */
+    void invert();
 
-    bool match(char a, bool flag_s);
+    ByteSet &operator|=(const ByteSet &other);
+    bool operator==(const ByteSet &other) const;
 
-    bool in[129]; // 对于中括号字符组[]，记录能匹配的字符
+    /**
+     * 特殊字符对应的集合
+     * @param by d s w D S W 或 .
+     * @param flag_s 是否有s修饰符（.是否匹配换行）
+     */
+    static ByteSet special(char by, bool flag_s);
+};
 
-    std::string times;
+/**
+ * 表示一条状态转移规则。
+ * 非epsilon转移能匹配的字节保存在NFA::sets中（相同的集合只保存一份），这里只记录它的编号，
+ * 因此Rule中不再有字符串，判断是否匹配时也不需要比较字符串。
+ */
+struct Rule {
+    int dst; // 目的状态
+    RuleType type; // 状态转移的类型，取值见上方的宏定义。构造完成后只用来区分epsilon转移与非epsilon转移
+    int set = -1; // 非epsilon转移能匹配的字节集合在NFA::sets中的下标
 
+    int guard = 0; // 走这条转移之前，在当前位置必须成立的anchor条件（AnchorFlag的组合），0表示无条件。带anchor的epsilon转移（^ $ \b \B）也用它表示
+    std::vector<int> saves; // 走这条转移之前，需要在当前位置记录的捕获位置编号（被消去的epsilon路径上各状态的saves）。由NFA::removeEpsilon生成
+    std::vector<int> ops; // 走这条转移之前依次执行的计数器操作，每个为 计数器编号 * 4 + CounterOp，条件不成立时不能走这条转移。见NFA::count
 };
 
 /**
@@ -63,6 +121,46 @@ struct path_element{
 };
 
 
+/**
+ * (状态, 位置)的访问标记，每个格子只占1位，按状态优先排成一个连续的位向量。
+ * 每64位另记一个代数，代数与当前不同的那一组视为全部未访问，因此reset只需把当前代数加一，是O(1)的，空间可以在多次执行之间复用。
+ */
+class VisitedBitmap {
+public:
+    /**
+     * 清空全部标记，并保证能容纳num_states个状态 × width个位置
+     */
+    void reset(int num_states, int width);
+
+    bool test(int q, int index) const
+    {
+        size_t bit = (size_t)q * width + index;
+        return stamps[bit / 64] == gen && (words[bit / 64] >> (bit % 64) & 1);
+    }
+
+    void set(int q, int index)
+    {
+        size_t bit = (size_t)q * width + index;
+        if(stamps[bit / 64] != gen)
+        {
+            stamps[bit / 64] = gen;
+            words[bit / 64] = 0;
+        }
+        words[bit / 64] |= 1ULL << (bit % 64);
+    }
+
+    /**
+     * 占用的字节数
+     */
+    size_t byteSize() const { return words.capacity() * sizeof(uint64_t) + stamps.capacity() * sizeof(uint32_t); }
+
+private:
+    int width = 0;
+    std::vector<uint64_t> words;
+    std::vector<uint32_t> stamps; // stamps[i]!=gen表示words[i]已经过期，视为0
+    uint32_t gen = 0;
+};
+
 /**
  * 表示一条从初态到终态的路径。（也可以用来表示不存在路径的拒绝结果。）
  * 当输入字符串的执行结果是接受时，你需要根据接受的路径，正确实例化一个该结构体并返回。
@@ -81,6 +179,27 @@ struct Path {
  */
 std::ostream &operator<<(std::ostream &os, Path &path);
 
+bool w(char a);
+
+/**
+ * 在给定的上下文中判断anchor条件是否成立
+ * @param guard AnchorFlag的组合
+ * @param begin 当前位置是否满足^（文本开头，或m修饰符下前一个字符是换行）
+ * @param prev_word 前一个字符是否为单词字符（文本开头视为非单词字符）
+ * @param next 下一个字节，-1表示文本结尾
+ * @param flag_m 是否有m修饰符
+ */
+bool guardHolds(int guard, bool begin, bool prev_word, int next, bool flag_m);
+
+/**
+ * 判断一条转移在文本的index位置是否满足它的anchor条件（见Rule::guard）。不带条件的转移总是可以通过。
+ * @param rule 转移
+ * @param text 文本
+ * @param index 当前所在字符串的位置
+ * @param flag_m 是否有m修饰符
+ */
+bool checkAnchor(const Rule &rule, std::string_view text, int index, bool flag_m);
+
 /**
  * 表示一个NFA的类。
  * 本类定义的自动机，约定状态用编号0~(num_states-1)表示，初态固定为0。
@@ -89,36 +208,121 @@ class NFA {
 public:
     int num_states = 0; // 状态个数
     std::vector<bool> is_final; // 用于判断状态是否为终态的数组，长为num_states。is_final[i]为true表示状态i为终态。
-    std::vector<std::vector<Rule>> rules; // 表示所有状态转移规则的二维数组，长为num_states。rules[i]表示从状态i出发的所有转移规则。
+    std::vector<std::vector<Rule>> original_rules; // removeEpsilon(true)时保存的原始转移规则，用于将exec的结果还原为原来的路径
+    std::vector<ByteSet> sets; // 所有非epsilon转移用到的字节集合，由internSet去重
+    unsigned char classes[256] = {}; // 字节的等价类：任何一条转移都不区分同一类中的字节（\b \B和m修饰符下的^ $也不区分），由computeClasses生成
+    unsigned char class_rep[256] = {}; // class_rep[k]为第k类中最小的字节
+    int num_classes = 1; // 等价类的个数
+    std::vector<std::vector<Rule>> rules; // 表示所有状态转移规则的二维数组，长为num_states。rules[i]表示从状态i出发的所有转移规则。rules[i]中越靠后的规则优先级越高（exec中后入栈的先被尝试）。
 
-    std::vector<std::pair<int, int> > group[20001];
+    std::vector<std::vector<std::pair<int, int> > > group; // group[k]为第k+1个分组的各份（起始状态, 结束状态），由addGroup按需扩充
 
     int group_num = 0;
 
-    std::string full_text;
-    int p;
+    // {m,n}展开后过大时用计数器代替展开（见NFABuilder::counted）。带计数器的NFA只能用PikeVM执行，
+    // 其他引擎（BitState、OnePass、Glushkov、惰性DFA、DFA、反向NFA）都要求counters为空；NFA::exec忽略计数器
+    std::vector<Counter> counters;
+
+    // saves[i]表示进入状态i时需要记录当前位置的捕获位置编号。第k个分组(k从1开始)的起止位置编号分别为2k和2k+1，由initSaves()根据group生成
+    std::vector<std::vector<int>> saves;
+
+    std::string_view full_text; // exec的输入，只在exec期间有效
+    int p = 0;
 
     bool flag_m = 0;
     bool flag_s = 0;
 
+    static const long long DEFAULT_MAX_VISITED_BITS = 1LL << 28; // visited的默认预算（位），约32MB，另有一半用于代数
+
     std::vector<stack_element> Stack;
-    std::set<int> Set[20001];
+    long long max_visited_bits = DEFAULT_MAX_VISITED_BITS; // num_states * (文本长度 + 1)超过它时，exec改用sparse_visited
+    VisitedBitmap visited; // exec中已经入过栈的(状态, 位置)
+    std::unordered_set<uint64_t> sparse_visited; // 超出预算时代替visited，键为位置 * num_states + 状态，只占用实际访问到的个数
+    std::vector<path_element> path; // exec中当前的路径，path[k]为第k步的状态，按需扩充，在多次exec之间复用
+
+    /**
+     * 判断非epsilon转移rule能否匹配字节a
+     */
+    bool match(const Rule &rule, char a) const { return sets[rule.set].test((unsigned char)a); }
+
+    /**
+     * 返回集合在sets中的下标，相同的集合只保存一份
+     */
+    int internSet(const ByteSet &set);
+
+    /**
+     * 根据sets计算字节的等价类。在构造完所有转移之后调用
+     */
+    void computeClasses();
+
+    /**
+     * 新增一个没有转移的状态，返回它的编号。rules随状态个数增长，不需要预先分配
+     */
+    int addState();
+
+    /**
+     * 记录第k+1个分组的一份起止状态（{m,n}展开后一个分组可以有多份）
+     */
+    void addGroup(int k, int begin, int end);
+
+    /**
+     * 依次执行ops中的计数器操作
+     * @param values 各个计数器的值，原地修改
+     * @return 条件是否全部成立。不成立时values的内容不确定
+     */
+    bool count(const std::vector<int> &ops, int *values) const;
+
+    /**
+     * 估计本对象占用的字节数（包括各个容器在堆上分配的空间）
+     */
+    size_t byteSize() const;
 
     /**
      * 在自动机上执行指定的输入字符串。
+     * 访问标记超出max_visited_bits时改用哈希集合，结果相同，只是更慢。
      * TODO 请你完成这个函数；请在nfa.cpp中完成。
      * @param text 输入字符串
      * @return 若拒绝，请 return Path::reject(); 。若接受，请手工构造一个Path的实例并返回。
      */
-    Path exec(std::string text);
+    Path exec(std::string_view text);
 
     Path backtrace(path_element path[], int step);
 
+    /**
+     * 根据group中记录的每个分组的起止状态，生成saves数组
+     */
+    void initSaves();
+
+    /**
+     * 消去epsilon转移，原地修改。状态的编号不变。
+     * 对每个初态或由非epsilon转移到达的状态，按优先级遍历它的epsilon闭包，把闭包中各状态的非epsilon转移按同样的顺序复制过来，
+     * 路径上的anchor成为转移的guard，路径上的saves、计数器操作成为转移的saves、ops。
+     * 闭包中到达的终态保留为一条epsilon转移（进入终态的转移），它在规则列表中的位置表示接受的优先级。
+     * @param keep_original 是否保存原来的转移规则。保存时exec返回的Path会被还原为原来的状态和epsilon转移
+     */
+    void removeEpsilon(bool keep_original = false);
+
+    /**
+     * 将在消去epsilon转移后的NFA上得到的路径，还原为original_rules上的路径（补上被消去的epsilon转移经过的状态）
+     * @param path exec得到的路径
+     * @param text 输入字符串
+     * @param start 路径开始时所在字符串的位置
+     */
+    Path restorePath(const Path &path, std::string_view text, int start) const;
+
+    /**
+     * 构造反向的NFA：在它上面从右往左读入text[s, e)（anchor中的^和$互换），能够接受当且仅当text[s, e)能被本NFA匹配。
+     * 本NFA需已消去epsilon转移，且不带计数器。反向NFA只用于判断是否接受，不记录捕获，转移的优先级也没有意义。
+     * 原来的guard要在转移之前的位置成立，反向读入时这个位置在转移之后，所以反向NFA的状态是(原状态, 尚待检查的guard)，
+     * 待检查的guard放在下一条转移（或接受）上
+     */
+    NFA reverse() const;
+
     /**
      * 从自动机的文本表示构造自动机
      * 你不需要理解此函数的含义、阅读此函数的实现和调用此函数。
      */
-    static NFA from_text(const std::string &text);
+    static NFA from_text(std::string_view text);
 };
 
 #endif //CPP_NFA_H
@@ -0,0 +1,130 @@
+#include "onepass.h"
+
+bool OnePass::eligible(const NFA &nfa)
+{
+    if((long long)nfa.num_states * nfa.num_classes > MAX_TABLE || !nfa.counters.empty())
+        return false;
+
+    std::vector<int> owner(nfa.num_classes);
+    for(int i = 0; i < nfa.num_states; i++)
+    {
+        if(nfa.is_final[i])
+            continue;
+        std::fill(owner.begin(), owner.end(), -1);
+        for(const Rule &r: nfa.rules[i])
+        {
+            if(r.type == EPSILON)
+            {
+                if(!nfa.is_final[r.dst])
+                    return false;
+                continue;
+            }
+            for(int k = 0; k < nfa.num_classes; k++)
+            {
+                if(!nfa.sets[r.set].test(nfa.class_rep[k]))
+                    continue;
+                if(owner[k] >= 0)
+                    return false;
+                owner[k] = 1;
+            }
+        }
+    }
+    return true;
+}
+
+OnePass::OnePass(const NFA &nfa) : nfa(nfa)
+{
+    num_slots = 2 * (nfa.group_num + 1);
+    table.assign((size_t)nfa.num_states * nfa.num_classes, -1);
+    accepts.resize(nfa.num_states);
+    for(int i = 0; i < nfa.num_states; i++)
+        for(int j = nfa.rules[i].size() - 1; j >= 0; j--)
+        {
+            const Rule &r = nfa.rules[i][j];
+            if(r.type == EPSILON)
+            {
+                accepts[i].push_back(j);
+                continue;
+            }
+            for(int k = 0; k < nfa.num_classes; k++)
+                if(nfa.sets[r.set].test(nfa.class_rep[k]))
+                    table[i * nfa.num_classes + k] = j;
+        }
+}
+
+size_t OnePass::byteSize() const
+{
+    size_t size = sizeof(OnePass) + table.capacity() * sizeof(int);
+    size += accepts.capacity() * sizeof(accepts[0]);
+    for(auto &a: accepts)
+        size += a.capacity() * sizeof(int);
+    return size;
+}
+
+void OnePass::accept(const Rule &r, int index, const std::vector<int> &cap, std::vector<int> &slots) const
+{
+    slots = cap;
+    for(int slot: r.saves)
+        slots[slot] = index;
+    for(int slot: nfa.saves[r.dst])
+        slots[slot] = index;
+    slots[1] = index;
+}
+
+/**
+ * 每一步先查表得到当前字节上唯一的转移，再按优先级处理进入终态的转移：
+ * 下标比这条转移大的（更优先）成立时立即接受；下标更小的只在转移走得通时记为候选，走不通时直接接受
+*/
+bool OnePass::exec(std::string_view text, int start, std::vector<int> &slots, int end, std::vector<int> &cap) const
+{
+    cap.assign(num_slots, -1);
+    cap[0] = start;
+    for(int slot: nfa.saves[0])
+        cap[slot] = start;
+    if(nfa.is_final[0])
+    {
+        slots = cap;
+        slots[1] = start;
+        return true;
+    }
+
+    bool matched = false;
+    int q = 0;
+    for(int index = start; ; index++)
+    {
+        int j = index < end ? table[q * nfa.num_classes + nfa.classes[(unsigned char)text[index]]] : -1;
+        const Rule *r = j >= 0 ? &nfa.rules[q][j] : nullptr;
+        if(r && !checkAnchor(*r, text, index, nfa.flag_m))
+            r = nullptr;
+
+        // 可以接受时，比r优先的直接结束；否则记为候选
+        for(int a: accepts[q])
+        {
+            const Rule &e = nfa.rules[q][a];
+            if(!checkAnchor(e, text, index, nfa.flag_m))
+                continue;
+            if(r == nullptr || a > j)
+            {
+                accept(e, index, cap, slots);
+                return true;
+            }
+            accept(e, index, cap, slots);
+            matched = true;
+            break;
+        }
+        if(r == nullptr)
+            return matched;
+
+        for(int slot: r->saves)
+            cap[slot] = index;
+        q = r->dst;
+        for(int slot: nfa.saves[q])
+            cap[slot] = index + 1;
+        if(nfa.is_final[q])
+        {
+            slots = cap;
+            slots[1] = index + 1;
+            return true;
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef CPP_ONEPASS_H
+#define CPP_ONEPASS_H
+
+#include "nfa.h"
+
+/**
+ * one-pass的NFA引擎。若NFA中每个状态在每个字节（等价类）上至多只有一条非epsilon转移可以走，
+ * 那么从一个固定的起点出发，路径是唯一确定的：只需从左到右走一遍，捕获位置直接记在唯一的一组slots上，
+ * 不需要PikeVM的线程列表，也不需要回溯。
+ * 进入终态的epsilon转移（见NFA::removeEpsilon）在运行时按优先级处理：比当前字节上的转移优先的，成立时立即结束；
+ * 不如它优先的，成立时先记为候选，之后的路径走不通时使用最后一个候选，这与leftmost-first的语义一致。
+ * 本引擎只用于已知起点的匹配（三步搜索的最后一步，见Regex::search）。
+ */
+class OnePass {
+public:
+    static const long long MAX_TABLE = 1 << 20; // 转移表最多的项数
+
+    /**
+     * 判断NFA是否为one-pass：已消去epsilon转移，不带计数器，且每个非终态在每个等价类上至多有一条非epsilon转移
+     */
+    static bool eligible(const NFA &nfa);
+
+    /**
+     * @param nfa 要执行的NFA，需满足eligible，并在OnePass的生命周期内保持不变
+     */
+    explicit OnePass(const NFA &nfa);
+
+    /**
+     * 求以start为起点的匹配，只读入[start, end)中的字节（anchor仍按整个text判断），slots的格式同PikeVM::exec
+     * @param cap 临时空间，由调用者提供，因此多个线程可以共享同一个OnePass
+     * @return 是否匹配成功
+     */
+    bool exec(std::string_view text, int start, std::vector<int> &slots, int end, std::vector<int> &cap) const;
+
+    /**
+     * 占用的字节数
+     */
+    size_t byteSize() const;
+
+private:
+    /**
+     * 在index处经由进入终态的转移r接受，cap为当前的捕获位置，结果写入slots
+     */
+    void accept(const Rule &r, int index, const std::vector<int> &cap, std::vector<int> &slots) const;
+
+    const NFA &nfa;
+    int num_slots;
+    std::vector<int> table; // table[q*num_classes+k]为状态q在等价类k上唯一的那条非epsilon转移在rules[q]中的下标，-1表示没有
+    std::vector<std::vector<int>> accepts; // accepts[q]为状态q中进入终态的epsilon转移的下标，按优先级从高到低排列
+};
+
+#endif //CPP_ONEPASS_H
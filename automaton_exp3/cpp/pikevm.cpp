@@ -0,0 +1,298 @@
+#include "pikevm.h"
+#include <algorithm>
+
+PikeVM::PikeVM(const NFA &nfa, const Prefilter *prefilter) : nfa(nfa), prefilter(prefilter)
+{
+    num_slots = 2 * (nfa.group_num + 1);
+    width = num_slots + nfa.counters.size();
+
+    consumes.assign(nfa.num_states, false);
+    for(int i = 0; i < nfa.num_states; i++)
+    {
+        if(nfa.is_final[i])
+            consumes[i] = 1;
+        for(const Rule &r: nfa.rules[i])
+            if(r.type != EPSILON)
+                consumes[i] = 1;
+    }
+
+    for(ThreadList *list: {&clist, &nlist})
+    {
+        list->sparse.assign(nfa.num_states, 0);
+        list->dense.assign(nfa.num_states, 0);
+        list->floors.assign((size_t)nfa.num_states * nfa.counters.size(), 0);
+    }
+    cap.assign(width, -1);
+}
+
+int PikeVM::probe(const ThreadList &list, int q, const int *counters) const
+{
+    int n = nfa.counters.size();
+    size_t h = q;
+    for(int c = 0; c < n; c++)
+        h = h * 1000003 + counters[c];
+    h = h * 0x9E3779B97F4A7C15ULL >> 20;
+    for(int b = h & (list.buckets - 1); ; b = (b + 1) & (list.buckets - 1))
+    {
+        const int *e = &list.configs[b * (n + 1)];
+        if(e[0] < 0 || (e[0] == q && std::equal(counters, counters + n, e + 1)))
+            return b * (n + 1);
+    }
+}
+
+bool PikeVM::dominates(const int *u, const int *v) const
+{
+    for(int c = 0; c < (int)nfa.counters.size(); c++)
+        if(u[c] != v[c] && (u[c] > v[c] || u[c] + 1 < nfa.counters[c].min))
+            return false;
+    return true;
+}
+
+/**
+ * 没有计数器时只需状态的稀疏集合。哈希表的负载超过一半时容量加倍，重新插入已有的项。
+ * 每个状态只保存一组floors，检查新的线程是否被它支配：先到的线程优先级更高；
+ * 新的线程支配floors，或者floors还有计数器没有满足下界而新的线程都满足时，用新的线程代替它。
+ * 比如(?:a{1,1000}){1,1000}中，同一状态上外层计数器不同的线程只留下最小的一个
+*/
+bool PikeVM::visit(ThreadList &list, int q, const int *counters)
+{
+    if(nfa.counters.empty())
+    {
+        if(list.contains(q))
+            return false;
+        list.insert(q);
+        return true;
+    }
+
+    int n = nfa.counters.size();
+    int *floors = &list.floors[(size_t)q * n];
+    if(list.contains(q) && dominates(floors, counters))
+        return false;
+    if(2 * ((int)list.used.size() + 1) > list.buckets)
+    {
+        std::vector<int> old;
+        for(int i: list.used)
+            old.insert(old.end(), list.configs.begin() + i, list.configs.begin() + i + n + 1);
+        list.buckets = std::max(64, 2 * list.buckets);
+        list.configs.assign((size_t)list.buckets * (n + 1), -1);
+        list.used.clear();
+        for(size_t i = 0; i < old.size(); i += n + 1)
+        {
+            int e = probe(list, old[i], &old[i + 1]);
+            std::copy(old.begin() + i, old.begin() + i + n + 1, list.configs.begin() + e);
+            list.used.push_back(e);
+        }
+    }
+
+    int e = probe(list, q, counters);
+    if(list.configs[e] >= 0)
+        return false;
+    list.configs[e] = q;
+    std::copy(counters, counters + n, list.configs.begin() + e + 1);
+    list.used.push_back(e);
+
+    auto satisfied = [&](const int *v) {
+        for(int c = 0; c < n; c++)
+            if(v[c] + 1 < nfa.counters[c].min)
+                return false;
+        return true;
+    };
+    if(!list.contains(q))
+        list.insert(q);
+    else if(!dominates(counters, floors) && (satisfied(floors) || !satisfied(counters)))
+        return true;
+    std::copy(counters, counters + n, floors);
+    return true;
+}
+
+void PikeVM::save(const std::vector<int> &slots, int index, std::vector<int> &cap)
+{
+    for(int slot: slots)
+    {
+        stack.push_back({-1, slot, cap[slot], nullptr});
+        cap[slot] = index;
+    }
+}
+
+/**
+ * 将状态q及其epsilon闭包按优先级加入list
+ * 用显式的栈代替递归；进入某个状态时记录捕获位置，并在栈中压入一个恢复元素，该状态的所有后继处理完后再恢复。
+ * 转移上的计数器操作同样在进入时执行、处理完后恢复，条件不成立时不走这条转移
+ * @param cap 进入q之前的捕获位置和计数器，函数返回时内容不变
+*/
+void PikeVM::addThread(ThreadList &list, int q, int index, std::string_view text, std::vector<int> &cap)
+{
+    stack.clear();
+    stack.push_back({q, 0, 0, nullptr});
+
+    while(!stack.empty())
+    {
+        closure_element e = stack.back();
+        stack.pop_back();
+
+        if(e.q < 0)
+        {
+            cap[e.slot] = e.old;
+            continue;
+        }
+        int *values = &cap[num_slots];
+        if(e.via && !e.via->ops.empty())
+        {
+            counters.assign(values, values + nfa.counters.size());
+            if(!nfa.count(e.via->ops, counters.data()))
+                continue;
+            values = counters.data();
+        }
+        if(!visit(list, e.q, values))
+            continue;
+        for(int c = 0; c < (int)nfa.counters.size(); c++)
+            if(values[c] != cap[num_slots + c])
+            {
+                stack.push_back({-1, num_slots + c, cap[num_slots + c], nullptr});
+                cap[num_slots + c] = values[c];
+            }
+
+        if(e.via)
+            save(e.via->saves, index, cap);
+        if(e.q < (int)nfa.saves.size())
+            save(nfa.saves[e.q], index, cap);
+
+        if(consumes[e.q])
+        {
+            list.threads.push_back(e.q);
+            list.caps.insert(list.caps.end(), cap.begin(), cap.end());
+        }
+
+        // 终态之后的转移不会被尝试（exec到达终态就返回）
+        if(nfa.is_final[e.q])
+            continue;
+
+        // rules中越靠后越优先，所以按顺序压栈，最后压入的最先弹出
+        for(const Rule &r: nfa.rules[e.q])
+        {
+            if(r.type != EPSILON || (nfa.counters.empty() && list.contains(r.dst)))
+                continue;
+            if(consumes[e.q] && nfa.is_final[r.dst])
+                continue;
+            if(checkAnchor(r, text, index, nfa.flag_m))
+                stack.push_back({r.dst, 0, 0, &r});
+        }
+    }
+}
+
+/**
+ * 在text中从start开始向后搜索第一个匹配
+ * 每一步先处理上一步留下的线程，再以最低的优先级在当前位置开启一个新线程（尚未找到匹配时），
+ * 某个线程到达终态后，优先级比它低的线程全部丢弃，优先级更高的线程继续推进，以保证leftmost-first。
+ * 流式匹配时，读入text的最后一个字节后仍有存活的线程，结果就依赖于后面的输入：这些线程都比已经找到的匹配优先，其中最早的起点就是*pending。
+ * 这些线程不求epsilon闭包，text的末尾不是整个输入的末尾，闭包中的anchor要等后面的字节才能判断
+*/
+bool PikeVM::exec(std::string_view text, int start, std::vector<int> &slots, int end, int *pending)
+{
+    int len = text.length();
+    int stop = end < 0 ? len : end; // 只读入stop之前的字节
+    bool anchored = end >= 0;
+    bool matched = false;
+
+    clist.clear();
+    nlist.clear();
+    Prefilter::Cache cache;
+
+    for(int index = start; ; index++)
+    {
+        // 没有存活的线程时，下一个起点之前的位置都不必处理
+        if(!matched && !anchored && !pending && prefilter && clist.threads.empty() && index < len)
+        {
+            int next = prefilter->next(text, index, cache);
+            if(next < 0)
+                break;
+            if(next > index)
+            {
+                clist.clear();
+                index = next;
+            }
+        }
+        if(!matched && index < len && (!anchored || index == start))
+        {
+            cap.assign(width, 0);
+            std::fill(cap.begin(), cap.begin() + num_slots, -1);
+            cap[0] = index;
+            addThread(clist, 0, index, text, cap);
+        }
+        if(clist.threads.empty() && (matched || index >= len || anchored))
+            break;
+
+        // cut为true表示本步中已有线程到达终态，优先级更低的线程和转移都不再处理
+        bool cut = false;
+        int waiting = len; // 流式匹配时读入最后一个字节后存活的线程的最早起点
+        for(int t = 0; t < (int)clist.threads.size() && !cut; t++)
+        {
+            int q = clist.threads[t];
+            int *c = &clist.caps[t * width];
+
+            if(nfa.is_final[q])
+            {
+                slots.assign(c, c + num_slots);
+                slots[1] = index;
+                matched = cut = true;
+                break;
+            }
+
+            for(int k = nfa.rules[q].size() - 1; k >= 0 && !cut; k--)
+            {
+                const Rule &r = nfa.rules[q][k];
+                if(r.type == EPSILON)
+                {
+                    // 进入终态的epsilon转移，见consumes的注释
+                    if(nfa.is_final[r.dst] && checkAnchor(r, text, index, nfa.flag_m) && allows(r, c))
+                    {
+                        slots.assign(c, c + num_slots);
+                        for(int slot: r.saves)
+                            slots[slot] = index;
+                        for(int slot: nfa.saves[r.dst])
+                            slots[slot] = index;
+                        slots[1] = index;
+                        matched = cut = true;
+                    }
+                    continue;
+                }
+                if(index >= stop || (nfa.counters.empty() && nlist.contains(r.dst)))
+                    continue;
+                if(nfa.match(r, text[index]) && checkAnchor(r, text, index, nfa.flag_m))
+                {
+                    cap.assign(c, c + width);
+                    if(!r.ops.empty() && !nfa.count(r.ops, &cap[num_slots]))
+                        continue;
+                    for(int slot: r.saves)
+                        cap[slot] = index;
+                    if(pending && index + 1 == len)
+                        waiting = std::min(waiting, cap[0]);
+                    else
+                        addThread(nlist, r.dst, index + 1, text, cap);
+                }
+            }
+        }
+        if(waiting < len)
+        {
+            *pending = waiting;
+            return false;
+        }
+
+        if(index >= stop)
+            break;
+        std::swap(clist, nlist);
+        nlist.clear();
+    }
+
+    if(pending && !matched)
+        *pending = len;
+    return matched;
+}
+
+bool PikeVM::allows(const Rule &r, const int *c)
+{
+    if(r.ops.empty())
+        return true;
+    counters.assign(c + num_slots, c + width);
+    return nfa.count(r.ops, counters.data());
+}
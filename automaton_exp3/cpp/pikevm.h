@@ -0,0 +1,124 @@
+#ifndef CPP_PIKEVM_H
+#define CPP_PIKEVM_H
+
+#include "nfa.h"
+#include "prefilter.h"
+
+/**
+ * Pike VM：在NFA的rules图上做Thompson模拟。
+ * 所有线程随输入同步推进，每个线程带有自己的一组捕获位置（slots），同一步中每个状态最多保留一个线程，
+ * 因此时间复杂度为 O(状态数 × 文本长度)，不需要NFA::exec中的Set[]来剪枝。
+ * 线程之间的先后顺序就是优先级，与exec的回溯顺序一致（rules[i]中越靠后的规则越优先），
+ * 所以分支的先后、贪婪与非贪婪的语义都保持不变（leftmost-first）。
+ * NFA带计数器（见NFA::counters）时，线程在捕获位置之后还带有各个计数器的值，同一步中状态和计数器都相同的线程才合并，
+ * 被同一状态上优先级更高的线程支配的线程丢弃（见dominates），线程数最多为 状态数 × 计数器取值的组合数。
+ */
+class PikeVM {
+public:
+    /**
+     * @param prefilter 可选。没有存活的线程时用它跳到下一个可能的起点
+     */
+    explicit PikeVM(const NFA &nfa, const Prefilter *prefilter = nullptr);
+
+    /**
+     * 在text中从start开始向后搜索第一个匹配。匹配的起点只会在[start, text.length())之中。
+     * @param text 输入文本
+     * @param start 搜索的起点
+     * @param slots 输出。匹配成功时，slots[0] slots[1]为整个匹配的起止位置，slots[2k] slots[2k+1]为第k个分组的起止位置，未参与匹配的分组为-1
+     * @param end 不为-1时，只尝试以start为起点的匹配，并且只读入[start, end)中的字节（anchor仍按整个text判断）。
+     *            已知匹配恰好是text[start, end)时，用它求捕获分组，代价只与匹配的长度有关
+     * @param pending 同LazyDFA::searchEnd：不为空时text只是输入的一部分，不读入END，也不使用预过滤。
+     *        结果依赖于后面的输入时返回false，*pending为尚未确定的匹配的最早可能起点；确定没有匹配时*pending为text的长度
+     * @return 是否匹配成功
+     */
+    bool exec(std::string_view text, int start, std::vector<int> &slots, int end = -1, int *pending = nullptr);
+
+private:
+    /**
+     * 一个线程列表：每个状态最多出现一次，按加入的先后保存优先级。
+     * sparse/dense为本步已访问过的状态的稀疏集合，可以O(1)清空；
+     * threads为其中需要在下一步继续推进的状态，第i个线程的捕获位置和计数器为caps[i*width, (i+1)*width)。
+     * 有计数器时已访问过的是(状态, 各计数器的值)，记在开放寻址的哈希表configs中：每项占1+计数器个数个int，状态为-1表示空，
+     * used为已占用的项的下标，清空时只需重置这些项。
+     * 此时sparse/dense记录的是本步已有floors的状态，floors[q*计数器个数, ...)为状态q上用来排除被支配的线程的计数器的值，见visit
+     */
+    struct ThreadList {
+        std::vector<int> sparse;
+        std::vector<int> dense;
+        int size = 0;
+        std::vector<int> threads;
+        std::vector<int> caps;
+        std::vector<int> configs;
+        std::vector<int> used;
+        int buckets = 0;
+        std::vector<int> floors;
+
+        bool contains(int q) const { return sparse[q] < size && dense[sparse[q]] == q; }
+        void insert(int q) { sparse[q] = size; dense[size++] = q; }
+        void clear()
+        {
+            size = 0;
+            threads.clear();
+            caps.clear();
+            for(int i: used)
+                configs[i] = -1;
+            used.clear();
+        }
+    };
+
+    /**
+     * 在list中标记状态q和计数器的值counters，已经标记过或被支配（见dominates）时返回false
+     */
+    bool visit(ThreadList &list, int q, const int *counters);
+
+    /**
+     * 同一状态上计数器的值为u的线程能走的路径，值为v的线程都能走（计数器操作都成立）时，称u支配v：
+     * 每个计数器u、v相等，或者u < v且u已经满足下界（COUNTER_EXIT都成立，COUNTER_LOOP对较小的值更容易成立）。
+     * 优先级更低的线程被支配时，它能到达的匹配优先级更高的线程都能到达，它不会成为结果，可以丢弃
+     */
+    bool dominates(const int *u, const int *v) const;
+
+    /**
+     * 在list.configs中查找(q, counters)，返回它所在或应当插入的项的下标
+     */
+    int probe(const ThreadList &list, int q, const int *counters) const;
+
+    /**
+     * 闭包栈中的元素。q>=0 表示要经由转移via（可以为空）加入的状态；q<0 表示恢复cap[slot]（捕获位置或计数器）为old
+     */
+    struct closure_element {
+        int q;
+        int slot;
+        int old;
+        const Rule *via;
+    };
+
+    /**
+     * 在当前位置记录一组捕获位置，并在栈中压入对应的恢复元素
+     */
+    void save(const std::vector<int> &slots, int index, std::vector<int> &cap);
+
+    /**
+     * 线程的捕获位置和计数器为c时，转移r上的计数器操作能否成立
+     */
+    bool allows(const Rule &r, const int *c);
+
+    /**
+     * 将状态q及其epsilon闭包按优先级加入list，cap为进入q之前的捕获位置
+     */
+    void addThread(ThreadList &list, int q, int index, std::string_view text, std::vector<int> &cap);
+
+    const NFA &nfa;
+    const Prefilter *prefilter;
+    int num_slots;
+    int width; // 每个线程的捕获位置和计数器的个数
+    std::vector<bool> consumes; // consumes[i]表示状态i是否有非epsilon转移或为终态，只有这样的状态才需要保存线程
+    // 有非epsilon转移的状态中，进入终态的epsilon转移（由NFA::removeEpsilon产生）不在闭包中处理，
+    // 而是在推进线程时与其他转移一起按优先级处理，这样接受的优先级才与原来一致
+    ThreadList clist, nlist;
+    std::vector<closure_element> stack;
+    std::vector<int> cap;
+    std::vector<int> counters; // 检查计数器操作时的临时空间
+};
+
+#endif //CPP_PIKEVM_H
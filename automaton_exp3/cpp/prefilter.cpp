@@ -0,0 +1,289 @@
+#include "prefilter.h"
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PREFILTER_SSE2
+#include <emmintrin.h>
+#endif
+
+/**
+ * 从初态出发，只要当前状态只有唯一的一条转移、且这条转移只能匹配一个字节，这个字节就是所有匹配都必须有的前缀。
+ * 首字节集合为初态所有非epsilon转移能匹配的字节之并；初态能直接接受（可能匹配空串）时无法排除任何起点。
+ * 初态的每条转移（包括进入终态的转移）的guard都含有ANCHOR_BEGIN时，匹配只能从开头（行首）开始。
+ * 同理，进入终态的每条转移的guard都含有ANCHOR_END时，匹配只能在结尾结束。
+*/
+Prefilter Prefilter::analyze(const NFA &nfa)
+{
+    Prefilter pf;
+    pf.flag_m = nfa.flag_m;
+    if(nfa.num_states == 0 || nfa.is_final[0])
+        return pf;
+
+    pf.analyzeLengths(nfa);
+    pf.anchored = !nfa.rules[0].empty();
+    for(const Rule &r: nfa.rules[0])
+        if(!(r.guard & ANCHOR_BEGIN))
+            pf.anchored = false;
+
+    // 进入终态的转移都是带有$的epsilon转移时，匹配只能在结尾结束
+    pf.end_anchored = !nfa.flag_m;
+    for(int i = 0; i < nfa.num_states; i++)
+        if(!nfa.is_final[i])
+            for(const Rule &r: nfa.rules[i])
+                if(nfa.is_final[r.dst] && (r.type != EPSILON || !(r.guard & ANCHOR_END)))
+                    pf.end_anchored = false;
+
+    for(const Rule &r: nfa.rules[0])
+    {
+        if(r.type == EPSILON)
+            return pf;
+        pf.first |= nfa.sets[r.set];
+    }
+    for(int c = 0; c < 256; c++)
+        if(pf.first.test(c))
+            pf.first_bytes.push_back(c);
+    if(pf.first_bytes.size() == 256)
+        return pf;
+    pf.any_first = false;
+
+    int q = 0;
+    while((int)pf.prefix.size() < MAX_PREFIX && !nfa.is_final[q] && nfa.rules[q].size() == 1)
+    {
+        const Rule &r = nfa.rules[q][0];
+        if(r.type == EPSILON)
+            break;
+        const ByteSet &set = nfa.sets[r.set];
+        int count = 0, byte = 0;
+        for(int c = 0; c < 256 && count < 2; c++)
+            if(set.test(c))
+            {
+                count++;
+                byte = c;
+            }
+        if(count != 1)
+            break;
+        pf.prefix.push_back((char)byte);
+        q = r.dst;
+    }
+    return pf;
+}
+
+/**
+ * 匹配的长度是从初态到终态的路径上非epsilon转移的条数，终态之后的转移不会被走到。
+ * 最小长度按层广度优先求得（epsilon转移只会进入终态）；最大长度按深度优先的后序求最长路，有环时无界。
+ * 求最大长度时不排除到达不了终态的状态：惰性DFA中的线程同样会走到这些状态，流式匹配用最大长度判断线程最晚在哪里结束（见Regex::search）
+*/
+void Prefilter::analyzeLengths(const NFA &nfa)
+{
+    int n = nfa.num_states;
+    std::vector<std::vector<int>> back(n);
+    for(int i = 0; i < n; i++)
+        if(!nfa.is_final[i])
+            for(const Rule &r: nfa.rules[i])
+                back[r.dst].push_back(i);
+
+    // useful[q]表示从q可以到达终态
+    std::vector<bool> useful(n, false);
+    std::vector<int> queue;
+    for(int i = 0; i < n; i++)
+        if(nfa.is_final[i])
+        {
+            useful[i] = true;
+            queue.push_back(i);
+        }
+    for(int i = 0; i < (int)queue.size(); i++)
+        for(int q: back[queue[i]])
+            if(!useful[q])
+            {
+                useful[q] = true;
+                queue.push_back(q);
+            }
+    if(!useful[0])
+        return;
+
+    std::vector<bool> seen(n, false);
+    std::vector<int> current{0}, next;
+    seen[0] = true;
+    bool found = false;
+    for(int d = 0; !found && !current.empty(); d++)
+    {
+        for(int q: current)
+        {
+            for(const Rule &r: nfa.rules[q])
+            {
+                if(r.type == EPSILON && useful[r.dst])
+                    found = true;
+                else if(useful[r.dst] && !seen[r.dst])
+                {
+                    seen[r.dst] = true;
+                    next.push_back(r.dst);
+                }
+            }
+            if(nfa.is_final[q])
+                found = true;
+        }
+        if(found)
+            min_len = d;
+        current.swap(next);
+        next.clear();
+    }
+
+    // color: 0未访问，1在栈中，2已求出longest
+    std::vector<int> color(n, 0), longest(n, 0);
+    std::vector<std::pair<int, int>> stack{{0, 0}};
+    color[0] = 1;
+    while(!stack.empty())
+    {
+        int q = stack.back().first;
+        int k = stack.back().second++;
+        if(!nfa.is_final[q] && k < (int)nfa.rules[q].size())
+        {
+            const Rule &r = nfa.rules[q][k];
+            if(color[r.dst] == 1)
+                return;
+            if(color[r.dst] == 2)
+                longest[q] = std::max(longest[q], longest[r.dst] + (r.type != EPSILON));
+            else
+            {
+                color[r.dst] = 1;
+                stack.push_back({r.dst, 0});
+            }
+            continue;
+        }
+        color[q] = 2;
+        stack.pop_back();
+        if(!stack.empty())
+        {
+            int p = stack.back().first;
+            const Rule &r = nfa.rules[p][stack.back().second - 1];
+            longest[p] = std::max(longest[p], longest[q] + (r.type != EPSILON));
+        }
+    }
+    max_len = longest[0];
+}
+
+/**
+ * 各项条件依次把from向后推进：行首、必需字面量的窗口、前缀（首字节）。某一项推进了from之后，其他各项需要重新检查，
+ * 直到所有条件都不再推进from为止
+*/
+int Prefilter::next(std::string_view text, int from, Cache &cache) const
+{
+    int len = text.length();
+    while(from < len && len - from >= min_len)
+    {
+        int s = from;
+        if(anchored)
+            s = nextLineStart(text, s);
+        if(s >= 0 && !required.empty())
+            s = nextRequired(text, s, cache);
+        if(s >= 0 && !any_first)
+            s = nextFirst(text, s);
+        if(s == from || s < 0)
+            return s;
+        from = s;
+    }
+    return -1;
+}
+
+int Prefilter::nextLineStart(std::string_view text, int from) const
+{
+    if(from == 0)
+        return 0;
+    if(!flag_m)
+        return -1;
+    if(text[from - 1] == '\n')
+        return from;
+    const void *p = memchr(text.data() + from, '\n', text.length() - from);
+    return p ? (int)((const char *)p - text.data()) + 1 : -1;
+}
+
+int Prefilter::nextRequired(std::string_view text, int from, Cache &cache) const
+{
+    // 在[cache.from, cache.hit]中的起点，查找结果与上一次相同；没有出现时对之后的所有起点都成立
+    int hit;
+    if(cache.from >= 0 && from >= cache.from && (cache.hit < 0 || from <= cache.hit))
+        hit = cache.hit;
+    else
+    {
+        hit = required.find(text, from);
+        cache.from = from;
+        cache.hit = hit;
+    }
+    if(hit < 0)
+        return -1;
+    if(required_before >= 0 && hit - required_before > from)
+        return hit - required_before;
+    return from;
+}
+
+int Prefilter::nextFirst(std::string_view text, int from) const
+{
+    if(prefix.size() >= 2)
+    {
+        // std::string::find先用memchr找首字节，再比较其余部分
+        auto pos = text.find(prefix, from);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+    return scanFirst(text, from);
+}
+
+void Prefilter::setRequired(const LiteralInfo &info)
+{
+    if(info.strings.empty())
+        return;
+    // 与前缀重复的必需字面量不需要再找一遍
+    if(info.strings.size() == 1 && info.before == 0 && prefix.compare(0, info.strings[0].size(), info.strings[0]) == 0)
+        return;
+    required = LiteralSearcher(info.strings);
+    required_before = info.before;
+}
+
+#ifdef PREFILTER_SSE2
+static int lowestBit(unsigned mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+int Prefilter::scanFirst(std::string_view text, int from) const
+{
+    int len = text.length();
+    const char *data = text.data();
+    if(first_bytes.size() == 1)
+    {
+        const void *p = memchr(data + from, first_bytes[0], len - from);
+        return p ? (int)((const char *)p - data) : -1;
+    }
+
+    int i = from;
+#ifdef PREFILTER_SSE2
+    if(first_bytes.size() <= MAX_SCAN_BYTES)
+    {
+        __m128i needles[MAX_SCAN_BYTES];
+        int n = first_bytes.size();
+        for(int k = 0; k < n; k++)
+            needles[k] = _mm_set1_epi8((char)first_bytes[k]);
+        for(; i + 16 <= len; i += 16)
+        {
+            __m128i block = _mm_loadu_si128((const __m128i *)(data + i));
+            __m128i eq = _mm_cmpeq_epi8(block, needles[0]);
+            for(int k = 1; k < n; k++)
+                eq = _mm_or_si128(eq, _mm_cmpeq_epi8(block, needles[k]));
+            unsigned mask = _mm_movemask_epi8(eq);
+            if(mask)
+                return i + lowestBit(mask);
+        }
+    }
+#endif
+    for(; i < len; i++)
+        if(first.test(data[i]))
+            return i;
+    return -1;
+}
@@ -0,0 +1,90 @@
+#ifndef CPP_PREFILTER_H
+#define CPP_PREFILTER_H
+
+#include "nfa.h"
+#include "literals.h"
+
+/**
+ * 匹配起点的预过滤。编译时从NFA中分析出所有匹配共同的字面量前缀，或者匹配的第一个字节可能的集合；
+ * 搜索时先用memchr（前缀）或SSE2的字节比较（首字节集合）直接跳到下一个可能的起点，自动机只在这些位置上开启新的起点。
+ * 各个引擎在没有存活的线程（状态）时调用next，跳过中间不可能成为起点的位置。
+ * 如果正则表达式有必需字面量（见LiteralInfo），next还会先找到下一个必需字面量，只在它之前before个字节以内寻找起点，
+ * 文本中不含任何必需字面量时直接返回-1，自动机一个字节也不用处理。
+ * 此外还分析匹配是否只能从文本开头（m修饰符下为行首）开始，以及匹配的最小、最大长度，剩余的文本比最小长度短时不再寻找起点。
+ */
+class Prefilter {
+public:
+    static const int MAX_PREFIX = 64; // 前缀的最大长度
+    static const int MAX_SCAN_BYTES = 8; // 首字节集合不超过这么多个字节时逐个用SSE2比较，否则逐字节查集合
+
+    /**
+     * 分析NFA，NFA需已消去epsilon转移（见NFA::removeEpsilon）
+     */
+    static Prefilter analyze(const NFA &nfa);
+
+    /**
+     * 设置必需字面量，info为LiteralInfo::required()的结果
+     */
+    void setRequired(const LiteralInfo &info);
+
+    /**
+     * 是否能排除某些起点。不能时next总是返回from
+     */
+    bool active() const { return !any_first || !required.empty() || anchored || min_len > 0; }
+
+    /**
+     * 一次搜索中必需字面量的查找结果。next会被反复调用，已经找到的出现位置在越过它之前都可以复用，
+     * 因此每次搜索（每次exec）使用一个新的Cache
+     */
+    struct Cache {
+        int from = -1; // 上一次查找的起点，-1表示还没有查找过
+        int hit = -1; // 上一次查找的结果
+    };
+
+    /**
+     * 返回不小于from的第一个可能的匹配起点，没有则返回-1
+     */
+    int next(std::string_view text, int from, Cache &cache) const;
+
+    std::string prefix; // 所有匹配共同的字面量前缀，可以为空
+    ByteSet first; // 匹配的第一个字节可能的集合
+    bool any_first = true; // 为true表示无法排除任何起点（可能匹配空串，或第一个字节可以是任何字节）
+    bool anchored = false; // 为true表示所有匹配都以^开头，只能从文本开头（m修饰符下还有换行之后）开始
+    bool end_anchored = false; // 为true表示没有m修饰符，且所有匹配都以$结尾，只能在文本结尾结束
+    bool flag_m = false; // 是否有m修饰符
+    int min_len = 0; // 匹配的最小长度
+    int max_len = -1; // 从初态出发的任何路径（包括到达不了终态的）的最大长度，因此也是匹配的最大长度，-1表示无界
+
+private:
+    /**
+     * 计算min_len和max_len
+     */
+    void analyzeLengths(const NFA &nfa);
+
+    /**
+     * 不小于from的第一个行首（anchored时可能的起点），没有则返回-1
+     */
+    int nextLineStart(std::string_view text, int from) const;
+
+    /**
+     * 不小于from、且距离下一个必需字面量不超过required_before的第一个位置，文本中没有必需字面量时返回-1
+     */
+    int nextRequired(std::string_view text, int from, Cache &cache) const;
+
+    /**
+     * 不小于from的第一个以prefix开头（或首字节属于first）的位置，没有则返回-1
+     */
+    int nextFirst(std::string_view text, int from) const;
+
+    /**
+     * 在[from, len)中寻找第一个属于first的字节
+     */
+    int scanFirst(std::string_view text, int from) const;
+
+    std::vector<unsigned char> first_bytes; // first中的所有字节
+
+    LiteralSearcher required; // 必需字面量，为空表示没有
+    int required_before = -1; // 必需字面量的起点距匹配起点的最大距离，-1表示无界
+};
+
+#endif //CPP_PREFILTER_H
@@ -0,0 +1,331 @@
+#include "programfile.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+/**
+ * 头部：MAGIC、VERSION、ENDIAN_MARK、保留字段，各4字节；整个文件的长度、负载的校验和，各8字节
+*/
+static const size_t HEADER_SIZE = 32;
+
+static void put(std::string &out, int32_t value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void putArray(std::string &out, const void *data, size_t bytes)
+{
+    out.append(static_cast<const char*>(data), bytes);
+    out.append((4 - bytes % 4) % 4, '\0'); // 保持4字节对齐
+}
+
+[[noreturn]] static void corrupt(const std::string &message)
+{
+    throw std::runtime_error("程序文件无效：" + message);
+}
+
+static void getArray(const char *&p, const char *end, void *data, size_t bytes)
+{
+    size_t padded = bytes + (4 - bytes % 4) % 4;
+    if((size_t)(end - p) < padded)
+        corrupt("文件被截断");
+    if(bytes) // 空数组的data可能是nullptr
+        memcpy(data, p, bytes);
+    p += padded;
+}
+
+static int32_t get(const char *&p, const char *end)
+{
+    int32_t value;
+    getArray(p, end, &value, sizeof(value));
+    return value;
+}
+
+/**
+ * 读入一个长为count的int数组，每个元素需在[lo, hi)中
+*/
+static void getInts(const char *&p, const char *end, std::vector<int> &v, long long count, int lo, int hi)
+{
+    if(count < 0 || (long long)(end - p) / 4 < count)
+        corrupt("文件被截断");
+    v.resize(count);
+    getArray(p, end, v.data(), count * sizeof(int));
+    for(int x: v)
+        if(x < lo || x >= hi)
+            corrupt("数值越界");
+}
+
+/**
+ * 偏移数组：长为n+1，从0开始单调不减，最后一个元素是数据数组的长度
+*/
+static void checkOffsets(const std::vector<int> &offsets)
+{
+    if(offsets[0] != 0)
+        corrupt("偏移数组不从0开始");
+    for(size_t i = 1; i < offsets.size(); i++)
+        if(offsets[i] < offsets[i-1])
+            corrupt("偏移数组不单调");
+}
+
+uint64_t ProgramFile::checksum(const char *data, size_t size)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for(size_t i = 0; i < size; i++)
+    {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+std::string ProgramFile::write(const NFA &nfa, const NFA &reverse_nfa, const LiteralInfo &required)
+{
+    std::string out(HEADER_SIZE, '\0');
+    writeNFA(out, nfa);
+    writeNFA(out, reverse_nfa);
+
+    put(out, required.before);
+    put(out, required.strings.size());
+    for(const std::string &s: required.strings)
+    {
+        put(out, s.size());
+        putArray(out, s.data(), s.size());
+    }
+
+    uint32_t header[4] = {MAGIC, VERSION, ENDIAN_MARK, 0};
+    uint64_t size = out.size(), sum = checksum(out.data() + HEADER_SIZE, out.size() - HEADER_SIZE);
+    memcpy(&out[0], header, sizeof(header));
+    memcpy(&out[16], &size, sizeof(size));
+    memcpy(&out[24], &sum, sizeof(sum));
+    return out;
+}
+
+/**
+ * 计数器展开为按计数器排列的(min, max)。各状态的转移展开为：偏移数组rule_offsets，
+ * 以及按转移排列的dst、type、set、guard和转移上的saves、ops（同样是偏移数组 + 数据数组）
+*/
+void ProgramFile::writeNFA(std::string &out, const NFA &nfa)
+{
+    put(out, nfa.num_states);
+    put(out, nfa.flag_m);
+    put(out, nfa.flag_s);
+    put(out, nfa.group_num);
+    put(out, nfa.num_classes);
+    putArray(out, nfa.classes, 256);
+    putArray(out, nfa.class_rep, 256);
+
+    put(out, nfa.sets.size());
+    putArray(out, nfa.sets.data(), nfa.sets.size() * sizeof(ByteSet));
+
+    std::vector<unsigned char> is_final(nfa.is_final.begin(), nfa.is_final.end());
+    putArray(out, is_final.data(), is_final.size());
+
+    std::vector<int> counters;
+    for(const Counter &c: nfa.counters)
+    {
+        counters.push_back(c.min);
+        counters.push_back(c.max);
+    }
+    put(out, nfa.counters.size());
+    putArray(out, counters.data(), counters.size() * sizeof(int));
+
+    std::vector<int> rule_offsets{0}, dst, type, set, guard, save_offsets{0}, saves, op_offsets{0}, ops;
+    for(const std::vector<Rule> &rules: nfa.rules)
+    {
+        for(const Rule &r: rules)
+        {
+            dst.push_back(r.dst);
+            type.push_back(r.type);
+            set.push_back(r.set);
+            guard.push_back(r.guard);
+            saves.insert(saves.end(), r.saves.begin(), r.saves.end());
+            save_offsets.push_back(saves.size());
+            ops.insert(ops.end(), r.ops.begin(), r.ops.end());
+            op_offsets.push_back(ops.size());
+        }
+        rule_offsets.push_back(dst.size());
+    }
+    std::vector<int> state_save_offsets{0}, state_saves;
+    for(const std::vector<int> &s: nfa.saves)
+    {
+        state_saves.insert(state_saves.end(), s.begin(), s.end());
+        state_save_offsets.push_back(state_saves.size());
+    }
+    std::vector<int> group_offsets{0}, groups;
+    for(const auto &g: nfa.group)
+    {
+        for(const auto &copy: g)
+        {
+            groups.push_back(copy.first);
+            groups.push_back(copy.second);
+        }
+        group_offsets.push_back(groups.size() / 2);
+    }
+
+    for(const std::vector<int> *v: {&rule_offsets, &dst, &type, &set, &guard, &save_offsets, &saves, &op_offsets, &ops})
+        putArray(out, v->data(), v->size() * sizeof(int));
+    put(out, nfa.saves.size());
+    put(out, state_saves.size());
+    putArray(out, state_save_offsets.data(), state_save_offsets.size() * sizeof(int));
+    putArray(out, state_saves.data(), state_saves.size() * sizeof(int));
+    put(out, nfa.group.size());
+    put(out, groups.size() / 2);
+    putArray(out, group_offsets.data(), group_offsets.size() * sizeof(int));
+    putArray(out, groups.data(), groups.size() * sizeof(int));
+}
+
+void ProgramFile::read(const char *data, size_t size, NFA &nfa, NFA &reverse_nfa, LiteralInfo &required)
+{
+    if(size < HEADER_SIZE)
+        corrupt("文件被截断");
+    uint32_t header[4];
+    uint64_t total, sum;
+    memcpy(header, data, sizeof(header));
+    memcpy(&total, data + 16, sizeof(total));
+    memcpy(&sum, data + 24, sizeof(sum));
+    if(header[0] != MAGIC)
+        corrupt("不是正则表达式的程序文件");
+    if(header[2] != ENDIAN_MARK)
+        corrupt("字节序与本机不同");
+    if(header[1] != VERSION)
+        corrupt("版本为" + std::to_string(header[1]) + "，只支持" + std::to_string(VERSION));
+    if(total != size)
+        corrupt("文件长度不符");
+    if(checksum(data + HEADER_SIZE, size - HEADER_SIZE) != sum)
+        corrupt("校验和不符");
+
+    const char *p = data + HEADER_SIZE, *end = data + size;
+    readNFA(p, end, nfa, nullptr);
+    readNFA(p, end, reverse_nfa, &nfa);
+
+    required = LiteralInfo();
+    required.before = get(p, end);
+    int n = get(p, end);
+    if(n < 0 || n > end - p)
+        corrupt("字面量个数越界");
+    required.strings.resize(n);
+    for(std::string &s: required.strings)
+    {
+        int len = get(p, end);
+        if(len < 0 || len > end - p)
+            corrupt("字面量长度越界");
+        s.resize(len);
+        getArray(p, end, &s[0], len);
+    }
+    if(p != end)
+        corrupt("文件末尾有多余的内容");
+}
+
+/**
+ * 读入的同时检查所有下标都在范围内，保证损坏的文件不会让引擎越界访问
+ * 正向NFA要给捕获引擎用，每个状态都必须有saves；反向NFA只给LazyDFA用，不带saves、分组和计数器，分组个数与正向NFA相同
+*/
+void ProgramFile::readNFA(const char *&p, const char *end, NFA &nfa, const NFA *forward)
+{
+    bool captures = !forward;
+    int num_states = get(p, end);
+    if(num_states <= 0 || num_states > end - p)
+        corrupt("状态个数越界");
+    nfa.flag_m = get(p, end);
+    nfa.flag_s = get(p, end);
+    nfa.group_num = get(p, end);
+    nfa.num_classes = get(p, end);
+    // 每个捕获引擎的线程都带2 * group_num + 2个slot，group_num不受限制时很小的文件也能耗尽内存
+    if(nfa.group_num < 0 || (captures && nfa.group_num > num_states) || nfa.num_classes <= 0 || nfa.num_classes > 256)
+        corrupt("分组或等价类个数越界");
+    if(forward && nfa.group_num != forward->group_num)
+        corrupt("正向与反向NFA的分组个数不一致");
+    getArray(p, end, nfa.classes, 256);
+    getArray(p, end, nfa.class_rep, 256);
+    for(int c = 0; c < 256; c++)
+        if(nfa.classes[c] >= nfa.num_classes)
+            corrupt("等价类越界");
+
+    int num_sets = get(p, end);
+    if(num_sets < 0 || num_sets > (end - p) / (int)sizeof(ByteSet))
+        corrupt("字节集合个数越界");
+    nfa.sets.resize(num_sets);
+    getArray(p, end, nfa.sets.data(), num_sets * sizeof(ByteSet));
+
+    std::vector<unsigned char> is_final(num_states);
+    getArray(p, end, is_final.data(), num_states);
+    nfa.is_final.assign(is_final.begin(), is_final.end());
+
+    // PikeVM的每个线程还带每个计数器的值；每个计数器至少对应一个状态
+    int num_counters = get(p, end);
+    if(num_counters < 0 || num_counters > (captures ? num_states : 0))
+        corrupt("计数器个数越界");
+    nfa.counters.resize(num_counters);
+    for(Counter &c: nfa.counters)
+    {
+        c.min = get(p, end);
+        c.max = get(p, end);
+        if(c.min < 0 || c.max < -1 || (c.max >= 0 && c.max < std::max(c.min, 1)))
+            corrupt("计数器的范围无效");
+    }
+
+    int num_slots = 2 * nfa.group_num + 2;
+    std::vector<int> rule_offsets, dst, type, set, guard, save_offsets, saves, op_offsets, ops;
+    getInts(p, end, rule_offsets, num_states + 1, 0, 0x7fffffff);
+    checkOffsets(rule_offsets);
+    int num_rules = rule_offsets.back();
+    getInts(p, end, dst, num_rules, 0, num_states);
+    getInts(p, end, type, num_rules, NORMAL, GROUP + 1);
+    getInts(p, end, set, num_rules, -1, num_sets);
+    getInts(p, end, guard, num_rules, 0, 16);
+    getInts(p, end, save_offsets, num_rules + 1, 0, 0x7fffffff);
+    checkOffsets(save_offsets);
+    getInts(p, end, saves, save_offsets.back(), 0, num_slots);
+    getInts(p, end, op_offsets, num_rules + 1, 0, 0x7fffffff);
+    checkOffsets(op_offsets);
+    getInts(p, end, ops, op_offsets.back(), 0, 4 * num_counters);
+    for(int op: ops)
+        if(op % 4 > COUNTER_EXIT)
+            corrupt("计数器操作无效");
+
+    nfa.num_states = num_states;
+    nfa.rules.assign(num_states, std::vector<Rule>());
+    for(int q = 0; q < num_states; q++)
+    {
+        nfa.rules[q].resize(rule_offsets[q+1] - rule_offsets[q]);
+        for(int i = rule_offsets[q]; i < rule_offsets[q+1]; i++)
+        {
+            Rule &r = nfa.rules[q][i - rule_offsets[q]];
+            r.dst = dst[i];
+            r.type = (RuleType)type[i];
+            r.set = set[i];
+            r.guard = guard[i];
+            if(r.type != EPSILON && r.set < 0)
+                corrupt("转移缺少字节集合");
+            r.saves.assign(saves.begin() + save_offsets[i], saves.begin() + save_offsets[i+1]);
+            r.ops.assign(ops.begin() + op_offsets[i], ops.begin() + op_offsets[i+1]);
+        }
+    }
+
+    int num_saves = get(p, end), num_state_saves = get(p, end);
+    if(num_saves != (captures ? num_states : 0))
+        corrupt("saves的长度不符");
+    std::vector<int> state_save_offsets, state_saves;
+    getInts(p, end, state_save_offsets, num_saves + 1, 0, 0x7fffffff);
+    checkOffsets(state_save_offsets);
+    if(state_save_offsets.back() != num_state_saves)
+        corrupt("saves的长度不符");
+    getInts(p, end, state_saves, num_state_saves, 0, num_slots);
+    nfa.saves.assign(num_saves, std::vector<int>());
+    for(int q = 0; q < num_saves; q++)
+        nfa.saves[q].assign(state_saves.begin() + state_save_offsets[q], state_saves.begin() + state_save_offsets[q+1]);
+
+    int num_groups = get(p, end), num_copies = get(p, end);
+    if(num_groups < 0 || num_groups > (captures ? nfa.group_num : 0) || num_copies < 0 || num_copies > (end - p) / 8)
+        corrupt("分组个数越界");
+    std::vector<int> group_offsets, groups;
+    getInts(p, end, group_offsets, num_groups + 1, 0, 0x7fffffff);
+    checkOffsets(group_offsets);
+    if(group_offsets.back() != num_copies)
+        corrupt("分组的长度不符");
+    getInts(p, end, groups, 2 * num_copies, 0, num_states);
+    nfa.group.assign(num_groups, {});
+    for(int k = 0; k < num_groups; k++)
+        for(int i = group_offsets[k]; i < group_offsets[k+1]; i++)
+            nfa.group[k].emplace_back(groups[2*i], groups[2*i+1]);
+}
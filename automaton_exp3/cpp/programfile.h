@@ -0,0 +1,53 @@
+#ifndef CPP_PROGRAMFILE_H
+#define CPP_PROGRAMFILE_H
+
+#include <string>
+#include "nfa.h"
+#include "literals.h"
+
+/**
+ * compile结果的二进制格式。保存的是消去epsilon转移之后的正向NFA与反向NFA（状态、转移、字节集合、字节等价类、
+ * 捕获位置与分组、计数器）以及必需字面量，读入时不需要解析正则表达式、构造和化简NFA；
+ * 预过滤、OnePass、位并行引擎由读入的NFA直接生成（都是线性的），惰性DFA本来就在匹配时才构造。
+ *
+ * 文件由一个头部和若干个数组组成，所有整数都是本机字节序的32位整数（头部中有字节序标记，不一致时拒绝读入），
+ * 变长的部分（各状态的转移、转移上的捕获位置等）都展开为“偏移数组 + 数据数组”的形式，读入时按块复制，不逐项解析。
+ * 头部记录整个文件的长度和负载的校验和，截断或损坏的文件会被拒绝，版本号不同的文件也会被拒绝。
+ */
+class ProgramFile {
+public:
+    static const uint32_t MAGIC = 0x50584752; // "RGXP"
+    static const uint32_t VERSION = 3; // 格式有任何变化时加一
+    static const uint32_t ENDIAN_MARK = 0x01020304;
+
+    /**
+     * 生成二进制格式的内容。read要求group_num不超过状态个数，调用方需保证
+     * @param nfa 已消去epsilon转移、计算过等价类和saves的NFA
+     * @param reverse_nfa nfa.reverse()，nfa带计数器时为Regex::compile生成的占位NFA
+     * @param required 必需字面量，LiteralInfo::required()的结果
+     */
+    static std::string write(const NFA &nfa, const NFA &reverse_nfa, const LiteralInfo &required);
+
+    /**
+     * 读入write的结果。格式、版本或内容不正确时抛出std::runtime_error
+     * @param nfa 输出，需为空的NFA
+     * @param reverse_nfa 输出，需为空的NFA
+     * @param required 输出
+     */
+    static void read(const char *data, size_t size, NFA &nfa, NFA &reverse_nfa, LiteralInfo &required);
+
+private:
+    static void writeNFA(std::string &out, const NFA &nfa);
+
+    /**
+     * @param forward 读入反向NFA时为已读入的正向NFA，读入正向NFA时为nullptr
+     */
+    static void readNFA(const char *&p, const char *end, NFA &nfa, const NFA *forward);
+
+    /**
+     * 64位的FNV-1a
+     */
+    static uint64_t checksum(const char *data, size_t size);
+};
+
+#endif //CPP_PROGRAMFILE_H
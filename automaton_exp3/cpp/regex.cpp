@@ -1,503 +1,228 @@
 #include "regex.h"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+#include <cstdio>
+#include "mappedfile.h"
+#include "programfile.h"
+#include "scratchpool.h"
 
 /**
  * 注：如果你愿意，你可以自由的using namespace。
  */
 
+#ifdef REGEX_WITH_ANTLR
 /**
- * 由根节点为Regex的子树，构建自动机，每个子节点是Expression，分别调用compileExpression()函数
- * @param r 子树的根节点，为RegexContext类型
+ * 把ANTLR的语法分析树转换为抽象语法树。使用显式的栈：栈中每一帧是一个正在转换的Regex子树，
+ * 遇到分组时立即压入它的子树，因此捕获分组按左括号出现的顺序编号
+ * @param tree 语法分析树的根节点
+ * @param ast 输出
 */
-void Regex::compileRegex(regexParser::RegexContext *r)
+void Regex::buildAST(regexParser::RegexContext *tree, RegexAST &ast)
 {
-    // 当前的起始状态
-    int currentState = nfa.num_states-1;
-    std::vector<regexParser::ExpressionContext*> expressions = r->expression();
-
-    // 保存每个分支的最末尾状态
-    std::vector<int> stateList;
-    for(auto e: expressions)
-    {
-        // 对于每个分支，先新建一个状态，再连接这个分支
-        Rule tmp;
-        tmp.dst = nfa.num_states;
-        tmp.type = EPSILON;
-        // nfa.rules[currentState].push_back(tmp);
-        nfa.rules[currentState].insert(nfa.rules[currentState].begin(), tmp);
-
-        nfa.num_states++;
-
-        compileExpression(e);
-        stateList.push_back(nfa.num_states-1);
-        // stateList.insert(stateList.begin(), nfa.num_states-1);
-    }
-
-    for(int i = 0; i < stateList.size(); i++)
+    struct Frame {
+        regexParser::RegexContext *r;
+        int node; // r对应的NODE_ALTERNATION结点
+        std::vector<regexParser::ExpressionContext*> expressions;
+        size_t e = 0; // 下一个要转换的分支
+        int concat = -1; // 当前分支对应的NODE_CONCAT结点
+        std::vector<regexParser::ExpressionItemContext*> items;
+        size_t i = 0; // 当前分支中下一个要转换的项
+    };
+
+    ast.root = ast.addNode(NODE_ALTERNATION);
+    std::vector<Frame> stack(1);
+    stack[0].r = tree;
+    stack[0].node = ast.root;
+    stack[0].expressions = tree->expression();
+    while(!stack.empty())
     {
-        // 新建一个状态，将这多条分支的最末尾状态汇总到这个状态
-        Rule tmp;
-        tmp.dst = nfa.num_states;
-        tmp.type = EPSILON;
-        nfa.rules[stateList[i]].push_back(tmp);
-    }
-    // 更新
-    nfa.num_states++;
-
-}
-
-/**
- * 由根节点为Expression的子树，构建自动机，每个子节点是ExpressionItem，分别调用compileExpressionItem()函数
- * @param e 子树的根节点，为ExpressionContext类型
-*/
-void Regex::compileExpression(regexParser::ExpressionContext *e)
-{
-    std::vector<regexParser::ExpressionItemContext*> expressionItems = e->expressionItem();
-
-    for(auto ei: expressionItems)
-    {
-        compileExpressionItem(ei);
-    }
-}
-
-/**
- * 由根节点为ExpressionItem的子树，构建自动机，如果子节点是single，则调用compileSingle()函数，如果是group，则调用compileRegex()函数
- * @param ei 子树的根节点，为ExpressionItemContext类型
-*/
-void Regex::compileExpressionItem(regexParser::ExpressionItemContext *ei)
-{
-    regexParser::NormalItemContext *ni = ei->normalItem();
-    regexParser::QuantifierContext *q = ei->quantifier();
-    regexParser::AnchorContext *a = ei->anchor();
-
-    // 当前的起始状态
-    int currentState = nfa.num_states-1;
-
-    /**
-     * 对于有quantifier限定符的处理，需要对相应的自动机进行处理，在外围添加其他epsilon转移。
-     * tmp1 在当前最开始的状态后接一个状态，作为该部分item的开头
-     * tmp2 在该item的末尾后接一个状态
-     * tmp3 将最开始的状态直接跨过该item，连接到最后那个状态
-     * tmp4 将最后那个状态返回指向最开始的状态
-     * tmp5 连在当前item的末尾，作为下一个item的起点
-     * 对于贪婪匹配与否的处理，主要就是这些规则添加的先后顺序
-    */
-    if(q != nullptr)
-    {
-        if(q->quantifierType()->rangeQuantifier())
+        Frame &f = stack.back();
+        if(f.i < f.items.size())
         {
-            int p = nfa.group_num;
-
-            if(ni->group())
-            {
-                if(!ni->group()->groupNonCapturingModifier())
-                    nfa.group_num++;
-            }
-
-            int lower = std::stoi(q->quantifierType()->rangeQuantifier()->rangeQuantifierLowerBound()->getText());
-            for(int i = 0; i < lower; i++)
-            {
-                int newCurrent = nfa.num_states-1;
-                Rule tmp1;
-                tmp1.dst = nfa.num_states;
-                tmp1.type = EPSILON;
-
-                nfa.rules[newCurrent].push_back(tmp1);
-                nfa.num_states++;
-
-                if(ni->single())
-                    compileSingle(ni->single());
-                else
-                {
-                    compileRegex(ni->group()->regex());
-                    if(!ni->group()->groupNonCapturingModifier())
-                        nfa.group[p].push_back(std::make_pair(newCurrent+1, nfa.num_states-1));
-                }
-
-                Rule tmp2;
-                tmp2.dst = nfa.num_states;
-                tmp2.type = EPSILON;
-
-                nfa.rules[nfa.num_states-1].push_back(tmp2);
-                nfa.num_states++;
-            }
-
-            if(q->quantifierType()->rangeQuantifier()->rangeDelimiter())
+            regexParser::ExpressionItemContext *ei = f.items[f.i++];
+            regexParser::NormalItemContext *ni = ei->normalItem();
+            int n;
+            if(ni == nullptr)
             {
-                // 相当于后接了 upper-lower 个ZeroOrOne
-                if(q->quantifierType()->rangeQuantifier()->rangeQuantifierUpperBound())
-                {
-                    int upper = std::stoi(q->quantifierType()->rangeQuantifier()->rangeQuantifierUpperBound()->getText());
-
-                    for(int j = lower; j < upper; j++)
-                    {
-                        int newCurrent = nfa.num_states-1;
-                        Rule tmp1;
-                        tmp1.dst = nfa.num_states;
-                        tmp1.type = EPSILON;
-
-                        nfa.rules[newCurrent].push_back(tmp1);
-                        nfa.num_states++;
-
-                        if(ni->single())
-                            compileSingle(ni->single());
-                        else
-                        {
-                            compileRegex(ni->group()->regex());
-                            if(!ni->group()->groupNonCapturingModifier())
-                                nfa.group[p].push_back(std::make_pair(newCurrent+1, nfa.num_states-1));
-                        }
-
-                        Rule tmp2;
-                        tmp2.dst = nfa.num_states;
-                        tmp2.type = EPSILON;
-
-                        nfa.rules[nfa.num_states-1].push_back(tmp2);
-                        nfa.num_states++;
-
-                        Rule tmp3;
-                        tmp3.dst = nfa.num_states-1;
-                        tmp3.type = EPSILON;
-
-                        if(q->lazyModifier())
-                            nfa.rules[newCurrent].push_back(tmp3);
-                        else
-                            nfa.rules[newCurrent].insert(nfa.rules[newCurrent].begin(), tmp3);
-
-                    }
-
-                }
-
-                // 相当于后接了个ZeroOrMore
+                auto a = ei->anchor();
+                if(a->AnchorStartOfString())
+                    n = ast.addNode(NODE_ANCHOR, ANCHOR_BEGIN);
+                else if(a->AnchorEndOfString())
+                    n = ast.addNode(NODE_ANCHOR, ANCHOR_END);
+                else if(a->AnchorWordBoundary())
+                    n = ast.addNode(NODE_ANCHOR, ANCHOR_WORD);
+                // AnchorNonWordBoundary
                 else
-                {
-                    int newCurrent = nfa.num_states-1;
-                    Rule tmp1;
-                    tmp1.dst = nfa.num_states;
-                    tmp1.type = EPSILON;
-
-                    nfa.rules[newCurrent].push_back(tmp1);
-                    nfa.num_states++;
-
-                    if(ni->single())
-                        compileSingle(ni->single());
-                    else
-                    {
-                        if(!ni->group()->groupNonCapturingModifier())
-                            nfa.group_num++;
-                        compileRegex(ni->group()->regex());
-                        if(!ni->group()->groupNonCapturingModifier())
-                            nfa.group[p].push_back(std::make_pair(newCurrent+1, nfa.num_states-1));
-                    }
-
-                    Rule tmp2;
-                    tmp2.dst = nfa.num_states;
-                    tmp2.type = EPSILON;
-
-                    nfa.rules[nfa.num_states-1].push_back(tmp2);
-                    nfa.num_states++;
-
-                    Rule tmp3;
-                    tmp3.dst = nfa.num_states-1;
-                    tmp3.type = EPSILON;
-
-                    Rule tmp4;
-                    tmp4.dst = newCurrent;
-                    tmp4.type = EPSILON;
-
-                    Rule tmp5;
-                    tmp5.dst = nfa.num_states;
-                    tmp5.type = EPSILON;
-                    nfa.rules[nfa.num_states-1].push_back(tmp5);
-                    nfa.num_states++;
-
-                    if(q->lazyModifier())
-                    {
-                        nfa.rules[newCurrent].push_back(tmp3);
-                        nfa.rules[nfa.num_states-2].insert(nfa.rules[nfa.num_states-2].begin(), tmp4);
-                    }
-                    else
-                    {
-                        nfa.rules[newCurrent].insert(nfa.rules[newCurrent].begin(), tmp3);
-                        nfa.rules[nfa.num_states-2].push_back(tmp4);
-                    }
-                }
+                    n = ast.addNode(NODE_ANCHOR, ANCHOR_NOT_WORD);
+                ast.addChild(f.concat, n);
+                continue;
             }
-        }
-
-        else
-        {
-            int p = nfa.group_num;
-
-            Rule tmp1;
-            tmp1.dst = nfa.num_states;
-            tmp1.type = EPSILON;
-
-            nfa.rules[currentState].push_back(tmp1);
-            nfa.num_states++;
 
             if(ni->single())
-                compileSingle(ni->single());
-            else
             {
-                if(!ni->group()->groupNonCapturingModifier())
-                    nfa.group_num++;
-                compileRegex(ni->group()->regex());
-                if(!ni->group()->groupNonCapturingModifier())
-                    nfa.group[p].push_back(std::make_pair(currentState+1, nfa.num_states-1));
-            }
-
-            Rule tmp2;
-            tmp2.dst = nfa.num_states;
-            tmp2.type = EPSILON;
-
-            nfa.rules[nfa.num_states-1].push_back(tmp2);
-            nfa.num_states++;
-
-            Rule tmp3;
-            tmp3.dst = nfa.num_states-1;
-            tmp3.type = EPSILON;
-
-            Rule tmp4;
-            tmp4.dst = currentState;
-            tmp4.type = EPSILON;
-
-            Rule tmp5;
-            tmp5.dst = nfa.num_states;
-            tmp5.type = EPSILON;
-            nfa.rules[nfa.num_states-1].push_back(tmp5);
-            nfa.num_states++;
-
-            if(q->quantifierType()->ZeroOrOneQuantifier())
-            {
-                // 非贪婪
-                if(q->lazyModifier())
-                    nfa.rules[currentState].push_back(tmp3);
-                // 贪婪
-                else
-                    nfa.rules[currentState].insert(nfa.rules[currentState].begin(), tmp3);
+                ast.sets.push_back(singleSet(ni->single()));
+                n = ast.addNode(NODE_SET, ast.sets.size() - 1);
             }
+            else
+                n = ast.addNode(NODE_GROUP, ni->group()->groupNonCapturingModifier() ? -1 : ast.group_num++);
+            ast.addChild(f.concat, n);
 
-            else if(q->quantifierType()->ZeroOrMoreQuantifier())
+            regexParser::QuantifierContext *q = ei->quantifier();
+            if(q != nullptr)
             {
-                if(q->lazyModifier())
-                {
-                    nfa.rules[currentState].push_back(tmp3);
-                    nfa.rules[nfa.num_states-2].insert(nfa.rules[nfa.num_states-2].begin(), tmp4);
-                }
+                RegexNode &node = ast.nodes[n];
+                node.lazy = q->lazyModifier() != nullptr;
+                auto type = q->quantifierType();
+                if(type->ZeroOrOneQuantifier())
+                    node.quantifier = QUANT_ZERO_OR_ONE;
+                else if(type->ZeroOrMoreQuantifier())
+                    node.quantifier = QUANT_ZERO_OR_MORE;
+                else if(type->OneOrMoreQuantifier())
+                    node.quantifier = QUANT_ONE_OR_MORE;
+                // rangeQuantifier
                 else
                 {
-                    nfa.rules[currentState].insert(nfa.rules[currentState].begin(), tmp3);
-                    nfa.rules[nfa.num_states-2].push_back(tmp4);
+                    auto range = type->rangeQuantifier();
+                    node.quantifier = QUANT_RANGE;
+                    node.min = node.max = std::stoi(range->rangeQuantifierLowerBound()->getText());
+                    if(range->rangeDelimiter())
+                        node.max = range->rangeQuantifierUpperBound() ? std::stoi(range->rangeQuantifierUpperBound()->getText()) : -1;
                 }
             }
 
-            // OneOrMore
-            else
+            if(ni->group())
             {
-                if(q->lazyModifier())
-                    nfa.rules[nfa.num_states-2].insert(nfa.rules[nfa.num_states-2].begin(), tmp4);
-                else
-                    nfa.rules[nfa.num_states-2].push_back(tmp4);
+                // 注意push_back之后f可能失效
+                Frame child;
+                child.r = ni->group()->regex();
+                child.node = ast.addNode(NODE_ALTERNATION);
+                child.expressions = child.r->expression();
+                ast.addChild(n, child.node);
+                stack.push_back(std::move(child));
             }
         }
-    }
-
-    else if(ni != nullptr)
-    {
-        int p = nfa.group_num;
-        std::vector<std::pair<int, int> > g;
-        if(ni->single())
-            compileSingle(ni->single());
-        else
+        else if(f.e < f.expressions.size())
         {
-            if(!ni->group()->groupNonCapturingModifier())
-                nfa.group_num++;
-            compileRegex(ni->group()->regex());
-            if(!ni->group()->groupNonCapturingModifier())
-                nfa.group[p].push_back(std::make_pair(currentState, nfa.num_states-1));
+            f.concat = ast.addNode(NODE_CONCAT);
+            ast.addChild(f.node, f.concat);
+            f.items = f.expressions[f.e++]->expressionItem();
+            f.i = 0;
         }
-
-        Rule tmp5;
-        tmp5.dst = nfa.num_states;
-        tmp5.type = EPSILON;
-
-        nfa.rules[nfa.num_states-1].push_back(tmp5);
-        nfa.num_states++;
-
-    }
-    
-    // anchor
-    else
-    {
-        Rule tmp;
-        tmp.dst = nfa.num_states;
-        tmp.type = EPSILON;
-        if(a->AnchorStartOfString())
-            tmp.by = "^";
-        else if(a->AnchorEndOfString())
-            tmp.by = "$";
-        else if(a->AnchorWordBoundary())
-            tmp.by = "b";
-        // AnchorNonWordBoundary
         else
-            tmp.by = "B";
-        
-        nfa.rules[currentState].push_back(tmp);
-        nfa.num_states++;
+            stack.pop_back();
     }
-
-    
 }
 
 /**
- * 由根节点为Single的子树，构建自动机，新建一条Rule，根据子节点的类型，设置其type和by等内容
+ * Single能匹配的字节集合，根据子节点的类型得到
  * @param s 子树的根节点，为SingleContext类型
 */
-void Regex::compileSingle(regexParser::SingleContext *s)
+ByteSet Regex::singleSet(regexParser::SingleContext *s)
 {
-    Rule tmp;
-    tmp.dst = nfa.num_states;
+    ByteSet set;
     if(s->char_())
     {
-        tmp.type = NORMAL;
         if(s->char_()->EscapedChar())
-        {
-            if(s->getText().substr(1) == "f")
-                tmp.by = "\f";
-            else if(s->getText().substr(1) == "n")
-                tmp.by = "\n";
-            else if(s->getText().substr(1) == "r")
-                tmp.by = "\r";
-            else if(s->getText().substr(1) == "t")
-                tmp.by = "\t";
-            else if(s->getText().substr(1) == "v")
-                tmp.by = "\v";
-            else
-                tmp.by = s->getText().substr(1);
-        
-        }
-
+            set.set(ASTParser::unescape(s->getText()[1]));
         else
-            tmp.by = s->getText();
+            set.set(s->getText()[0]);
     }
 
     else if(s->characterClass())
-    {
-        tmp.type = SPECIAL;
-        tmp.by = s->getText().substr(1);
-    }
+        set = ByteSet::special(s->getText()[1], nfa.flag_s);
 
     else if(s->AnyCharacter())
-    {
-        tmp.type = SPECIAL;
-        tmp.by = s->getText();
-    }
+        set = ByteSet::special('.', nfa.flag_s);
 
     // CharacterGroup
     else
     {
-        tmp.type = GROUP;
-
         std::vector<regexParser::CharacterGroupItemContext*> characterGroupitems = s->characterGroup()->characterGroupItem();
 
-        // 检测是否有取反
-        bool negativeModifier = 0;
-
-        if(s->characterGroup()->characterGroupNegativeModifier())
-            negativeModifier = 1;
-        
-        for(int i = 0; i < 129; i++)
-            tmp.in[i] = negativeModifier;
-
         for(auto i: characterGroupitems)
         {
             if(i->charInGroup())
             {
-                char a;
                 if(i->charInGroup()->EscapedChar())
-                {
-                    if(i->getText().substr(1) == "f")
-                        a = '\f';
-                    else if(i->getText().substr(1) == "n")
-                        a = '\n';
-                    else if(i->getText().substr(1) == "r")
-                        a = '\r';
-                    else if(i->getText().substr(1) == "t")
-                        a = '\t';
-                    else if(i->getText().substr(1) == "v")
-                        a = '\v';
-                    else
-                        a = i->getText().data()[1];
-                }
+                    set.set(ASTParser::unescape(i->getText()[1]));
                 else
-                    a = i->getText().data()[0];
-                tmp.in[a] = !negativeModifier;
+                    set.set(i->getText()[0]);
             }
 
             else if(i->characterClass())
             {
-                if(i->characterClass()->CharacterClassAnyWord())
-                {
-                    for(int j = 0; j < 129; j++)
-                        if((j >= 'a' && j <= 'z') || (j >= 'A' && j <= 'Z') || (j >= '0' && j <= '9') || j == '_')
-                            tmp.in[j] = !negativeModifier;
-                }
-
-                else if(i->characterClass()->CharacterClassAnyWordInverted())
-                {
-                    for(int j = 0; j < 129; j++)
-                        if(!((j >= 'a' && j <= 'z') || (j >= 'A' && j <= 'Z') || (j >= '0' && j <= '9') || j == '_'))
-                            tmp.in[j] = !negativeModifier;
-                }
-
-                else if(i->characterClass()->CharacterClassAnyDecimalDigit())
-                {
-                    for(int j = 0; j < 129; j++)
-                        if(j >= '0' && j <= '9')
-                            tmp.in[j] = !negativeModifier;
-                }
-
-                else if(i->characterClass()->CharacterClassAnyDecimalDigitInverted())
-                {
-                    for(int j = 0; j < 129; j++)
-                        if(!(j >= '0' && j <= '9'))
-                            tmp.in[j] = !negativeModifier;
-                }
-
-                else if(i->characterClass()->CharacterClassAnyBlank())
-                {
-                    for(int j = 0; j < 129; j++)
-                        if(j == ' ' || j == '\f' || j == '\n' || j == '\r' || j == '\t' || j == '\v')
-                            tmp.in[j] = !negativeModifier;
-                }
-
+                auto c = i->characterClass();
+                if(c->CharacterClassAnyWord())
+                    set |= ByteSet::special('w', nfa.flag_s);
+                else if(c->CharacterClassAnyWordInverted())
+                    set |= ByteSet::special('W', nfa.flag_s);
+                else if(c->CharacterClassAnyDecimalDigit())
+                    set |= ByteSet::special('d', nfa.flag_s);
+                else if(c->CharacterClassAnyDecimalDigitInverted())
+                    set |= ByteSet::special('D', nfa.flag_s);
+                else if(c->CharacterClassAnyBlank())
+                    set |= ByteSet::special('s', nfa.flag_s);
                 // CharacterClassAnyBlankInverted
                 else
-                {
-                    for(int j = 0; j < 129; j++)
-                        if(!(j == ' ' || j == '\f' || j == '\n' || j == '\r' || j == '\t' || j == '\v'))
-                            tmp.in[j] = !negativeModifier;
-                }
+                    set |= ByteSet::special('S', nfa.flag_s);
             }
 
             //characterRange
             else
             {
-                char start = i->characterRange()->charInGroup(0)->getText().data()[0];
-                char end = i->characterRange()->charInGroup(1)->getText().data()[0];
-
-                for(int j = (int)start; j <= (int)end; j++)
-                    tmp.in[j] = !negativeModifier;
+                auto lo = i->characterRange()->charInGroup(0);
+                auto hi = i->characterRange()->charInGroup(1);
+                char start = lo->EscapedChar() ? ASTParser::unescape(lo->getText()[1]) : lo->getText()[0];
+                char end = hi->EscapedChar() ? ASTParser::unescape(hi->getText()[1]) : hi->getText()[0];
+                set.setRange(start, end);
             }
         }
-    }
-
-    nfa.rules[nfa.num_states-1].push_back(tmp);
-    nfa.num_states++;
 
+        // 检测是否有取反
+        if(s->characterGroup()->characterGroupNegativeModifier())
+            set.invert();
+    }
+    return set;
 }
 
+/**
+ * ANTLR先解析，解析结果转换完之后语法分析树立即释放
+*/
+RegexAST Regex::parseValidated(const std::string &pattern)
+{
+    RegexAST expected;
+    std::string antlr_error;
+    try
+    {
+        buildAST(Regex::parse(pattern), expected);
+    }
+    catch(std::exception &e)
+    {
+        antlr_error = e.what();
+    }
+    releaseParser();
 
+    RegexAST ast;
+    try
+    {
+        ast = ASTParser::parse(pattern, nfa.flag_s);
+    }
+    catch(std::runtime_error &e)
+    {
+        if(antlr_error.empty())
+            throw std::runtime_error(std::string("手写的语法分析器报告了ANTLR没有报告的错误：") + e.what());
+        throw;
+    }
+    if(!antlr_error.empty())
+        throw std::runtime_error("手写的语法分析器没有报告ANTLR报告的错误：" + antlr_error);
+    if(!(ast == expected))
+        throw std::runtime_error("手写的语法分析器与ANTLR得到的抽象语法树不一致");
+    return ast;
+}
+#endif
 
 /**
  * 编译给定的正则表达式。
@@ -509,32 +234,110 @@ void Regex::compileSingle(regexParser::SingleContext *s)
  * @param flags 正则表达式的修饰符
  */
 void Regex::compile(const std::string &pattern, const std::string &flags) {
-    regexParser::RegexContext *tree = Regex::parse(pattern); // 这是语法分析树
-    // TODO 请你将在上次实验的内容粘贴过来，在其基础上进行修改。
-
+    if(nfa.num_states > 0) throw std::runtime_error("此Regex对象已被调用过一次compile函数，不可以再次调用！");
     if(flags.find("m") != std::string::npos)
         nfa.flag_m = 1;
     if(flags.find("s") != std::string::npos)
         nfa.flag_s = 1;
 
-    nfa.num_states = 1;
-
-    nfa.rules.resize(30000);
-
-    // 递归的入口，从根节点开始，递归构建自动机
-    compileRegex(tree);
+    // 默认使用手写的语法分析器直接得到抽象语法树，不经过ANTLR的语法分析树
+    RegexAST ast;
+#ifdef REGEX_WITH_ANTLR
+    if(validate_with_antlr)
+        ast = parseValidated(pattern);
+    else
+#endif
+        ast = ASTParser::parse(pattern, nfa.flag_s);
 
-    nfa.rules.resize(nfa.num_states);
+    NFABuilder(nfa, max_states, unroll_limit).build(ast);
+    LiteralInfo literals = LiteralInfo::analyze(ast);
 
     nfa.is_final.resize(nfa.num_states);
     nfa.is_final[nfa.num_states-1] = 1;
 
+    nfa.initSaves();
+    nfa.removeEpsilon();
+    nfa.computeClasses();
+    if(nfa.counters.empty())
+        reverse_nfa = nfa.reverse();
+    else
+    {
+        // 计数器不能反向执行，不使用反向NFA，只保留与正向相同的分组个数和修饰符（ProgramFile会检查）
+        reverse_nfa.addState();
+        reverse_nfa.is_final.assign(1, false);
+        reverse_nfa.group_num = nfa.group_num;
+        reverse_nfa.flag_m = nfa.flag_m;
+        reverse_nfa.flag_s = nfa.flag_s;
+        reverse_nfa.computeClasses();
+    }
+    required = literals.required();
+    buildEngines();
+
     // for(int i = 0; i < nfa.num_states; i++)
     //     for(auto j: nfa.rules[i])
-    //         std::cerr << i << " " << j.dst << " " << j.type << " " << j.by << std::endl;
+    //         std::cerr << i << " " << j.dst << " " << j.type << " " << j.set << std::endl;
     
 }
 
+/**
+ * 由nfa、reverse_nfa和required生成各个引擎，是compile与deserialize共同的最后一步。
+ * NFA带计数器时只有PikeVM能执行，不生成惰性DFA（OnePass、Glushkov也不会eligible）
+*/
+void Regex::buildEngines()
+{
+    prefilter = Prefilter::analyze(nfa);
+    prefilter.setRequired(required);
+    if(nfa.counters.empty())
+    {
+        dfa.reset(new LazyDFA(nfa, 4096, &prefilter));
+        reverse_dfa.reset(new LazyDFA(reverse_nfa, 4096, nullptr, true));
+    }
+    if(OnePass::eligible(nfa))
+        onepass.reset(new OnePass(nfa));
+    if(Glushkov::eligible(nfa))
+        bits.reset(new Glushkov(nfa, &prefilter));
+
+    static std::atomic<uint64_t> next_id{1};
+    id = next_id++;
+}
+
+std::string Regex::serialize() const
+{
+    if(id == 0)
+        throw std::runtime_error("此Regex对象尚未compile");
+    // 只有(a){0}这样不出现在NFA中的分组很多时才会这样
+    if(nfa.group_num > nfa.num_states)
+        throw std::runtime_error("分组个数超过NFA状态个数，无法保存");
+    return ProgramFile::write(nfa, reverse_nfa, required);
+}
+
+void Regex::save(const std::string &path) const
+{
+    std::string data = serialize();
+    FILE *f = fopen(path.c_str(), "wb");
+    if(!f)
+        throw std::system_error(errno, std::generic_category(), path);
+    size_t n = fwrite(data.data(), 1, data.size(), f);
+    if(fclose(f) != 0 || n != data.size())
+        throw std::system_error(errno, std::generic_category(), path);
+}
+
+void Regex::deserialize(const char *data, size_t size)
+{
+    if(nfa.num_states > 0) throw std::runtime_error("此Regex对象已被调用过一次compile函数，不可以再次调用！");
+    NFA forward, backward;
+    ProgramFile::read(data, size, forward, backward, required);
+    nfa = std::move(forward);
+    reverse_nfa = std::move(backward);
+    buildEngines();
+}
+
+void Regex::load(const std::string &path)
+{
+    MappedFile file(path);
+    deserialize(file.data(), file.size());
+}
+
 /**
  * 在给定的输入文本上，进行正则表达式匹配，返回匹配到的第一个结果。
  * 匹配不成功时，返回空vector( return std::vector<std::string>(); ，或使用返回初始化列表的语法 return {}; )；
@@ -543,66 +346,14 @@ void Regex::compile(const std::string &pattern, const std::string &flags) {
  * @param text 输入的文本
  * @return 如上所述
  */
-std::vector<std::string> Regex::match(std::string text) {
-    // TODO 请你将在上次实验的内容粘贴过来，在其基础上进行修改。
-    std::vector<std::string> result;
-
-    int len = text.length();
-
-    nfa.p = 0;
-    while(nfa.p < len)
-    {
-        Path path = nfa.exec(text);
-        
-        if(!path.states.empty())
-        {
-            std::string str;
-            for(int j = 0; j < path.consumes.size(); j++)
-                str.append(path.consumes[j]);
-
-            result.push_back(str);
-
-            for(int i = 0; i < nfa.group_num; i++)
-            {
-                int j = nfa.group[i].size()-1;
-                while(j >= 0)
-                {
-                    int k = path.states.size()-1;
-                    while(path.states[k] != nfa.group[i][j].first && k >= 0)
-                        k--;
-                    if(k < 0)
-                        j--;
-                    else
-                    {
-                        int l = k;
-                        while(path.states[l] != nfa.group[i][j].second && l < path.states.size())
-                            l++;
-                        if(l >= path.states.size())
-                            j--;
-                        else
-                        {
-                            std::string str0;
-                            for(int m = k; m < l; m++)
-                                str0.append(path.consumes[m]);
-                            result.push_back(str0);
-                            break;
-                        }
-                    }
-
-                }
-                if(j < 0)
-                {
-                    result.push_back("");
-                    continue;
-                }
-
-            }
+std::vector<std::string> Regex::match(std::string_view text) const {
+    return match(text, localScratch());
+}
 
-            return result;
-        }
-        else
-            nfa.p++;
-    }
+std::vector<std::string> Regex::match(std::string_view text, MatchScratch &scratch) const {
+    checkScratch(scratch);
+    if(search(scratch, text, 0, -1))
+        return groups(text, scratch.slots);
 
     return {};
 }
@@ -614,68 +365,60 @@ std::vector<std::string> Regex::match(std::string text) {
  * @param text 输入的文本
  * @return 如上所述
  */
-std::vector<std::vector<std::string>> Regex::matchAll(std::string text) {
-    // TODO 请你完成这个函数
-    std::vector<std::vector<std::string>> result;
+std::vector<std::vector<std::string>> Regex::matchAll(std::string_view text) const {
+    return matchAll(text, localScratch());
+}
 
-    int len = text.length();
+std::vector<std::vector<std::string>> Regex::matchAll(std::string_view text, MatchScratch &scratch) const {
+    checkScratch(scratch);
+    std::vector<std::vector<std::string>> result;
+    const std::vector<int> &slots = scratch.slots;
 
-    nfa.p = 0;
-    while(nfa.p < len)
+    int p = 0, last_end = -1;
+    while(search(scratch, text, p, last_end))
     {
-        std::vector<std::string> temp;
+        result.push_back(groups(text, slots));
 
-        Path path = nfa.exec(text);
-        if(!path.states.empty())
-        {
-            std::string str;
-            for(int j = 0; j < path.consumes.size(); j++)
-                str.append(path.consumes[j]);
-            temp.push_back(str);
+        last_end = slots[1];
+        // 空匹配之后从下一个位置继续
+        p = slots[1] > slots[0] ? slots[1] : slots[0] + 1;
+    }
 
-            for(int i = 0; i < nfa.group_num; i++)
-            {
-                int j = nfa.group[i].size()-1;
-                while(j >= 0)
-                {
-                    int k = path.states.size()-1;
-                    while(path.states[k] != nfa.group[i][j].first && k >= 0)
-                        k--;
-                    if(k < 0)
-                        j--;
-                    else
-                    {
-                        int l = k;
-                        while(path.states[l] != nfa.group[i][j].second && l < path.states.size())
-                            l++;
-                        if(l >= path.states.size())
-                            j--;
-                        else
-                        {
-                            std::string str0;
-                            for(int m = k; m < l; m++)
-                                str0.append(path.consumes[m]);
-                            temp.push_back(str0);
-                            break;
-                        }
-                    }
-                }
-                if(j < 0)
-                {
-                    temp.push_back("");
-                    continue;
-                }
-            }
-            
-            result.push_back(temp);
+    return result;
+}
+
+/**
+ * 按照replacement的规则，将一个匹配结果展开为替换后的内容
+ * $n表示第n个分组（n超出分组个数时替换为空），$$表示$本身，其他情况的$保持原样
+ */
+static std::string expandReplacement(const std::string &replacement, const std::vector<std::string> &result)
+{
+    std::string tmp;
+    int j = 0;
+    int len = replacement.length();
+    while(j < len)
+    {
+        if(replacement[j] != '$' || j == len-1)
+            tmp.push_back(replacement[j++]);
+        else if(replacement[j+1] == '$')
+        {
+            tmp.push_back('$');
+            j += 2;
+        }
+        else if(replacement[j+1] >= '0' && replacement[j+1] <= '9')
+        {
+            int k = j + 1;
+            while(k < len && replacement[k] >= '0' && replacement[k] <= '9')
+                k++;
+            int num = std::stoi(replacement.substr(j+1, k-j-1));
+            if(num < result.size())
+                tmp.append(result[num]);
+            j = k;
         }
         else
-            nfa.p++;
+            tmp.push_back(replacement[j++]);
     }
-
-    return result;
-    
-    // return {};
+    return tmp;
 }
 
 /**
@@ -685,124 +428,372 @@ std::vector<std::vector<std::string>> Regex::matchAll(std::string text) {
  * @param replacement 要将每一处正则表达式的匹配结果替换为什么内容
  * @return 替换后的文本
  */
-std::string Regex::replaceAll(std::string text, std::string replacement) {
-    // TODO 请你完成这个函数
+std::string Regex::replaceAll(std::string_view text, const std::string &replacement) const {
+    return replaceAll(text, replacement, localScratch());
+}
 
-    std::vector<std::vector<std::string>> result;
+std::string Regex::replaceAll(std::string_view text, const std::string &replacement, MatchScratch &scratch) const {
+    checkScratch(scratch);
+    std::string result;
+    const std::vector<int> &slots = scratch.slots;
 
-    std::vector<int> match_index;
+    // copied为text中已经复制到result中的前缀长度
+    int p = 0, last_end = -1, copied = 0;
+    while(search(scratch, text, p, last_end))
+    {
+        result.append(text, copied, slots[0] - copied);
+        result.append(expandReplacement(replacement, groups(text, slots)));
+        copied = slots[1];
 
-    int len = text.length();
+        last_end = slots[1];
+        p = slots[1] > slots[0] ? slots[1] : slots[0] + 1;
+    }
+    result.append(text, copied, std::string::npos);
 
-    nfa.p = 0;
-    while(nfa.p < len)
-    {
-        std::vector<std::string> temp;
+    return result;
+}
 
-        Path path = nfa.exec(text);
-        if(!path.states.empty())
+std::vector<std::vector<std::string>> Regex::matchAll(std::string_view text, int threads, ThreadPool &pool) const {
+    if(threads <= 0 || threads > pool.size())
+        threads = pool.size();
+    int chunks = std::min((long long)threads * 4, (long long)text.length() / std::max(parallel_chunk, 1));
+    if(threads == 1 || chunks < 2)
+        return matchAll(text);
+
+    std::vector<int> found = searchAll(text, chunks, pool);
+    int stride = 2 * (nfa.group_num + 1), n = found.size() / stride;
+    std::vector<std::vector<std::string>> result(n);
+    const int BLOCK = 4096;
+    pool.parallelFor(n, BLOCK, [&](size_t begin, size_t end) {
+        std::vector<int> slots(stride);
+        for(size_t k = begin; k < end; k++)
         {
-            std::string str;
-            for(int j = 0; j < path.consumes.size(); j++)
-                str.append(path.consumes[j]);
-            temp.push_back(str);
+            std::copy_n(found.begin() + k * stride, stride, slots.begin());
+            result[k] = groups(text, slots);
+        }
+    });
+    return result;
+}
 
-            match_index.push_back(nfa.p-str.length());
+/**
+ * 每个线程为一段连续的匹配生成替换结果（包括每个匹配之前未被替换的文本），最后依次拼接
+*/
+std::string Regex::replaceAll(std::string_view text, const std::string &replacement, int threads, ThreadPool &pool) const {
+    if(threads <= 0 || threads > pool.size())
+        threads = pool.size();
+    int chunks = std::min((long long)threads * 4, (long long)text.length() / std::max(parallel_chunk, 1));
+    if(threads == 1 || chunks < 2)
+        return replaceAll(text, replacement);
+
+    std::vector<int> found = searchAll(text, chunks, pool);
+    int stride = 2 * (nfa.group_num + 1), n = found.size() / stride;
+    const int BLOCK = 4096;
+    std::vector<std::string> pieces((n + BLOCK - 1) / BLOCK);
+    pool.parallelFor(pieces.size(), 1, [&](size_t first, size_t last) {
+        std::vector<int> slots(stride);
+        for(size_t b = first; b < last; b++)
+            for(size_t k = b * BLOCK; k < std::min<size_t>(n, (b + 1) * BLOCK); k++)
+            {
+                std::copy_n(found.begin() + k * stride, stride, slots.begin());
+                int copied = k > 0 ? found[(k - 1) * stride + 1] : 0;
+                pieces[b].append(text, copied, slots[0] - copied);
+                pieces[b].append(expandReplacement(replacement, groups(text, slots)));
+            }
+    });
+
+    size_t total = text.length() - (n > 0 ? found[(n - 1) * stride + 1] : 0);
+    for(const std::string &piece: pieces)
+        total += piece.length();
+    std::string result;
+    result.reserve(total);
+    for(const std::string &piece: pieces)
+        result.append(piece);
+    result.append(text, n > 0 ? found[(n - 1) * stride + 1] : 0, std::string::npos);
+    return result;
+}
 
-            for(int i = 0; i < nfa.group_num; i++)
+/**
+ * 合并时的关键：从某个位置开始的下一个匹配只取决于它的起点之前哪些位置扫描过且没有匹配，与从哪里开始扫描无关，
+ * 唯一的例外是紧接在上一个匹配之后的空匹配会被跳过（search的last_end参数）。
+ * 设某块在找到第j个匹配之前的状态为(start, last_end)，它扫描过[start, 第j个匹配的起点)。
+ * 当前状态(p, last)满足start <= p <= 第j个匹配的起点时，下一个匹配就是该块的第j个匹配，之后的匹配也都相同，
+ * 除非两者中只有一方跳过了p处的空匹配
+*/
+std::vector<int> Regex::searchAll(std::string_view text, int chunks, ThreadPool &pool) const
+{
+    struct Chunk {
+        std::vector<int> slots; // 起点在本块中、已经确定的匹配，依次排列
+        std::vector<std::pair<int, int>> before; // 找到每个匹配之前的状态(start, last_end)
+        std::pair<int, int> tail; // 最后一次没有找到匹配的搜索的状态
+        int pending; // [tail.first, pending)中没有匹配的起点
+    };
+
+    int len = text.length(), stride = 2 * (nfa.group_num + 1);
+    std::vector<int> ends(chunks);
+    for(int i = 0; i < chunks; i++)
+        ends[i] = (long long)len * (i + 1) / chunks;
+
+    // 在text长为x的前缀上，从状态(p, last)开始寻找已经确定的下一个匹配；x为整个文本时不需要流式查找
+    auto find = [&](MatchScratch &scratch, int x, int p, int last, int &pending) {
+        if(x < len)
+            return search(scratch, text.substr(0, x), p, last, &pending);
+        pending = len;
+        return search(scratch, text, p, last);
+    };
+
+    std::vector<Chunk> results(chunks);
+    pool.parallelFor(chunks, 1, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            Chunk &r = results[i];
+            MatchScratch &scratch = localScratch();
+            const std::vector<int> &slots = scratch.slots;
+            int p = i > 0 ? ends[i - 1] : 0, last = -1;
+            while(true)
             {
-                int j = nfa.group[i].size()-1;
-                while(j >= 0)
-                {
-                    int k = path.states.size()-1;
-                    while(path.states[k] != nfa.group[i][j].first && k >= 0)
-                        k--;
-                    if(k < 0)
-                        j--;
-                    else
-                    {
-                        int l = k;
-                        while(path.states[l] != nfa.group[i][j].second && l < path.states.size())
-                            l++;
-                        if(l >= path.states.size())
-                            j--;
-                        else
-                        {
-                            std::string str0;
-                            for(int m = k; m < l; m++)
-                                str0.append(path.consumes[m]);
-                            temp.push_back(str0);
-                            break;
-                        }
-                    }
-                }
-                if(j < 0)
-                {
-                    temp.push_back("");
-                    continue;
-                }
+                r.tail = {p, last};
+                if(!find(scratch, ends[i], p, last, r.pending))
+                    break;
+                r.before.push_back(r.tail);
+                r.slots.insert(r.slots.end(), slots.begin(), slots.begin() + stride);
+                last = slots[1];
+                p = slots[1] > slots[0] ? slots[1] : slots[0] + 1;
             }
-            
-            result.push_back(temp);
         }
-        else
-            nfa.p++;
-    }
-    
-    for(int i = match_index.size()-1; i >= 0; i--)
+    });
+
+    std::vector<int> result;
+    MatchScratch &scratch = localScratch();
+    const std::vector<int> &slots = scratch.slots;
+    int p = 0, last = -1;
+    for(int i = 0; i < chunks && p < len; i++)
     {
-        int j = 0;
-        std::string tmp = replacement;
-        while(j < tmp.length())
+        const Chunk &r = results[i];
+        int n = r.before.size(), j = 0;
+        while(p < ends[i])
         {
-            if(tmp[j] != '$' || (tmp[j] == '$' && j == tmp.length()-1))
-            {
+            // 块中起点不小于p的第一个匹配，p只会增大
+            while(j < n && r.slots[j * stride] < p)
                 j++;
-                continue;
-            }
-            // if(tmp[j] == '$' && j < tmp.length()-1)
-            else
+            std::pair<int, int> state = j < n ? r.before[j] : r.tail;
+            bool aligned = state.first <= p && !(state.first == p && state.second == p && last != p);
+            if(j < n && last == p && r.slots[j * stride] == p && r.slots[j * stride + 1] == p)
+                aligned = false;
+            if(aligned)
             {
-                if(tmp[j+1] == '$')
+                if(j < n)
                 {
-                    tmp.erase(j, 1);
-                    j++;
-                    continue;
+                    result.insert(result.end(), r.slots.begin() + j * stride, r.slots.end());
+                    p = r.tail.first;
+                    last = r.tail.second;
                 }
-                else if(tmp[j+1] >= '0' && tmp[j+1] <= '9')
+                p = std::max(p, r.pending);
+                if(p >= ends[i])
+                    break;
+            }
+
+            // 单独查找下一个匹配：只要确定[p, 块尾)中没有匹配的起点即可，前缀从块尾之后一点开始，每次加倍
+            for(long long margin = 256; ; margin *= 2)
+            {
+                int x = std::min((long long)len, ends[i] + margin), pending;
+                if(find(scratch, x, p, last, pending))
                 {
-                    int k = j + 1;
-                    while(tmp[k] >= '0' && tmp[k] <= '9')
-                        k++;
-                    int num = std::stoi(tmp.substr(j+1, k-j-1));
-                    if(num < result[i].size())
-                    {
-                        tmp.replace(j, k-j, result[i][num]);
-                        j += result[i][num].length();
-                        continue;
-                    }
-                    else
-                    {
-                        tmp.erase(j, k-j);
-                        continue;
-                    }
+                    result.insert(result.end(), slots.begin(), slots.begin() + stride);
+                    last = slots[1];
+                    p = slots[1] > slots[0] ? slots[1] : slots[0] + 1;
+                    break;
                 }
-                else
+                if(x == len || pending >= ends[i])
                 {
-                    j++;
-                    continue;
+                    p = pending;
+                    break;
                 }
-
             }
         }
-        text.replace(match_index[i], result[i][0].length(), tmp);
     }
+    return result;
+}
+
+/**
+ * 判断给定的文本中是否存在匹配
+ * 能用位并行引擎时直接使用它；否则使用惰性DFA，缓存失效或NFA带计数器时改用PikeVM
+ */
+bool Regex::test(std::string_view text) const {
+    return test(text, localScratch());
+}
+
+bool Regex::test(std::string_view text, MatchScratch &scratch) const {
+    checkScratch(scratch);
+    if(bits)
+        return bits->searchEarliest(text, 0) >= 0;
+
+    int end = dfa ? dfa->searchEnd(text, 0, scratch.forward, true) : LazyDFA::FAILED;
+    if(end != LazyDFA::FAILED)
+        return end >= 0;
+
+    return search(scratch, text, 0, -1);
+}
+
+/**
+ * 每段输入只查找一次当前线程的MatchScratch，之后逐个调用带scratch的match
+*/
+std::vector<std::vector<std::string>> Regex::matchBatch(const std::string_view *texts, size_t count, ThreadPool &pool) const
+{
+    std::vector<std::vector<std::string>> result(count);
+    pool.parallelFor(count, BATCH_GRAIN, [&](size_t begin, size_t end) {
+        MatchScratch &scratch = localScratch();
+        for(size_t i = begin; i < end; i++)
+            result[i] = match(texts[i], scratch);
+    });
+    return result;
+}
+
+std::vector<std::vector<std::string>> Regex::matchBatch(const std::vector<std::string_view> &texts, ThreadPool &pool) const
+{
+    return matchBatch(texts.data(), texts.size(), pool);
+}
+
+std::vector<char> Regex::testBatch(const std::string_view *texts, size_t count, ThreadPool &pool) const
+{
+    std::vector<char> result(count);
+    pool.parallelFor(count, BATCH_GRAIN, [&](size_t begin, size_t end) {
+        MatchScratch &scratch = localScratch();
+        for(size_t i = begin; i < end; i++)
+            result[i] = test(texts[i], scratch);
+    });
+    return result;
+}
+
+std::vector<char> Regex::testBatch(const std::vector<std::string_view> &texts, ThreadPool &pool) const
+{
+    return testBatch(texts.data(), texts.size(), pool);
+}
+
+/**
+ * 从start开始寻找下一个匹配
+ * 若找到的是紧接在上一个匹配之后的空匹配，则跳过它，从下一个位置继续寻找
+ * 分三步：正向的惰性DFA求出匹配的结束位置，反向的惰性DFA从结束位置往回求出起点，最后只在这一段上求捕获分组（能用OnePass时用它）。
+ * 只能在文本结尾结束的正则表达式（$）省去第一步，直接从结尾往回找。任何一个DFA的缓存失效时，退回到从start开始的整体搜索
+*/
+bool Regex::search(MatchScratch &scratch, std::string_view text, int start, int last_end, int *pending) const
+{
+    PikeVM &vm = scratch.vm;
+    BitState &bt = scratch.bt;
+    std::vector<int> &slots = scratch.slots;
+    int len = text.length();
+    Prefilter::Cache cache;
+    while(start < len)
+    {
+        // NFA带计数器时只能用PikeVM，预过滤和流式匹配都由它自己处理
+        if(!dfa)
+        {
+            if(!vm.exec(text, start, slots, -1, pending))
+                return false;
+            if(slots[0] != slots[1] || slots[0] != last_end)
+                return true;
+            start = slots[0] + 1;
+            continue;
+        }
+
+        int end;
+        if(pending)
+        {
+            // 流式匹配：预过滤可能跨过块的边界（必需字面量被切开、剩余长度不足min_len），不使用它
+            end = dfa->searchEnd(text, start, scratch.forward, false, pending);
+            if(end == LazyDFA::PARTIAL && prefilter.max_len >= 0)
+                *pending = std::max(*pending, len - prefilter.max_len);
+            if(end == LazyDFA::FAILED)
+                *pending = start;
+            if(end < 0)
+                return false;
+        }
+        // 剩余的文本中没有可能的起点（如^开头的正则表达式已经过了开头）时，不必启动引擎
+        else if((start = prefilter.next(text, start, cache)) < 0)
+            return false;
+        else
+            end = prefilter.end_anchored ? len : dfa->searchEnd(text, start, scratch.forward);
+
+        int begin = end >= 0 ? reverse_dfa->searchStart(text, end, start, scratch.backward) : end;
+        bool found;
+        if(end == LazyDFA::FAILED || begin == LazyDFA::FAILED)
+            found = bt.fits(len - start) ? bt.exec(text, start, slots) : vm.exec(text, start, slots);
+        else if(begin < 0 || begin >= len)
+            found = false;
+        else if(nfa.group_num == 0)
+        {
+            slots.assign({begin, end});
+            found = true;
+        }
+        else if(onepass)
+            found = onepass->exec(text, begin, slots, end, scratch.cap);
+        else
+            found = bt.fits(end - begin) ? bt.exec(text, begin, slots, end) : vm.exec(text, begin, slots, end);
 
+        if(!found)
+        {
+            if(pending)
+                *pending = start;
+            return false;
+        }
+        if(slots[0] != slots[1] || slots[0] != last_end)
+            return true;
+        start = slots[0] + 1;
+    }
+    if(pending)
+        *pending = std::min(start, len);
+    return false;
+}
 
-    return text;
+/**
+ * 将slots转换为match函数返回值的格式，未参与匹配的分组为空串
+*/
+std::vector<std::string> Regex::groups(std::string_view text, const std::vector<int> &slots) const
+{
+    std::vector<std::string> result;
+    for(int i = 0; i <= nfa.group_num; i++)
+    {
+        if(slots[2*i] >= 0 && slots[2*i+1] >= slots[2*i])
+            result.emplace_back(text.substr(slots[2*i], slots[2*i+1] - slots[2*i]));
+        else
+            result.push_back("");
+    }
+    return result;
+}
+
+MatchScratch &Regex::localScratch() const
+{
+    thread_local ScratchPool<MatchScratch> pool;
+
+    if(id == 0)
+        throw std::runtime_error("此Regex对象尚未compile");
+    if(MatchScratch *s = pool.find(id))
+        return *s;
+    return pool.insert(id, std::unique_ptr<MatchScratch>(new MatchScratch(*this)), scratch_pool);
 }
 
+void Regex::checkScratch(const MatchScratch &scratch) const
+{
+    if(scratch.owner != id)
+        throw std::invalid_argument("MatchScratch不属于此Regex对象");
+}
+
+MatchScratch::MatchScratch(const Regex &re)
+    : owner(re.id), vm(re.nfa, &re.prefilter), bt(re.nfa, re.bitstate_budget, &re.prefilter)
+{
+    if(owner == 0)
+        throw std::runtime_error("此Regex对象尚未compile");
+}
 
+/**
+ * 主要是两个惰性DFA的缓存；PikeVM与回溯引擎的工作空间与NFA的大小成正比，只计对象本身
+*/
+size_t MatchScratch::byteSize() const
+{
+    return sizeof(MatchScratch) + forward.byteSize() + backward.byteSize()
+        + (cap.capacity() + slots.capacity()) * sizeof(int);
+}
+
+#ifdef REGEX_WITH_ANTLR
 /**
  * 解析正则表达式的字符串，生成语法分析树。
  * 你应该在compile函数中调用一次本函数，以得到语法分析树。
@@ -828,10 +819,43 @@ regexParser::RegexContext *Regex::parse(const std::string &pattern) {
     return tree;
 }
 
+#endif
+
 // 此析构函数是为了管理ANTLR语法分析树所使用的内存的。你不需要阅读和理解它。
 Regex::~Regex() {
-    delete antlrInputStream;
-    delete antlrLexer;
-    delete antlrTokenStream;
+#ifdef REGEX_WITH_ANTLR
+    releaseParser();
+#endif
+}
+
+#ifdef REGEX_WITH_ANTLR
+/**
+ * 释放ANTLR语法分析树所使用的内存。compile结束时调用；compile中途抛出异常时由析构函数调用
+*/
+void Regex::releaseParser() {
     delete antlrParser;
+    delete antlrTokenStream;
+    delete antlrLexer;
+    delete antlrInputStream;
+    antlrParser = nullptr;
+    antlrTokenStream = nullptr;
+    antlrLexer = nullptr;
+    antlrInputStream = nullptr;
+}
+#endif
+
+/**
+ * 估计本对象占用的字节数：对象本身、NFA，以及各引擎的表。惰性DFA的缓存在MatchScratch中，不计在内
+*/
+size_t Regex::byteSize() const {
+    size_t size = sizeof(Regex) - 2 * sizeof(NFA) + nfa.byteSize() + reverse_nfa.byteSize();
+    if(dfa)
+        size += dfa->byteSize();
+    if(reverse_dfa)
+        size += reverse_dfa->byteSize();
+    if(onepass)
+        size += onepass->byteSize();
+    if(bits)
+        size += bits->byteSize();
+    return size;
 }
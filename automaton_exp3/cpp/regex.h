@@ -2,8 +2,20 @@
 #define CPP_REGEX_H
 
 #include "nfa.h"
+#include "pikevm.h"
+#include "bitstate.h"
+#include "lazydfa.h"
+#include "glushkov.h"
+#include "onepass.h"
+#include "builder.h"
+#include "astparser.h"
+#include "threadpool.h"
+#include <memory>
+#include <atomic>
+#ifdef REGEX_WITH_ANTLR
 #include "parser/regexLexer.h"
 #include "parser/regexParser.h"
+#endif
 
 /**
  * 本文件（包括对应的cpp文件）中已经定义好了一些类和函数，类内也已经定义好了一些成员变量和方法。不建议大家修改这些已经定义好的东西。
@@ -23,13 +35,18 @@
  * 正则表达式中各种字符的具体定义可查看 https://www.runoob.com/regexp/regexp-metachar.html
  */
 
+class MatchScratch;
+
 /**
  * 表示一个正则表达式的类。
+ * compile之后对象只读：所有匹配函数都是const的，匹配过程中的可变状态放在MatchScratch中，
+ * 因此同一个Regex可以被多个线程同时使用，不需要加锁，也不需要每个线程各编译一份。
  */
 class Regex {
 public:
     NFA nfa; // 正则表达式所使用的NFA
 
+#ifdef REGEX_WITH_ANTLR
     /**
      * 解析正则表达式的字符串，生成语法分析树。
      * 你应该在compile函数中调用一次本函数，以得到语法分析树。
@@ -39,6 +56,7 @@ public:
      * @return RegexContext类的对象的指针。保证不为空指针。
      */
     regexParser::RegexContext *parse(const std::string &pattern);
+#endif
 
     /**
      * 编译给定的正则表达式。
@@ -51,13 +69,45 @@ public:
      */
     void compile(const std::string &pattern, const std::string &flags = "");
 
-    void compileRegex(regexParser::RegexContext *r);
+#ifdef REGEX_WITH_ANTLR
+    /**
+     * 把语法分析树转换为抽象语法树（见RegexAST），NFA与字面量分析都在抽象语法树上进行
+     */
+    void buildAST(regexParser::RegexContext *tree, RegexAST &ast);
+
+    /**
+     * Single能匹配的字节集合
+     */
+    ByteSet singleSet(regexParser::SingleContext *s);
 
-    void compileExpression(regexParser::ExpressionContext *e);
+    /**
+     * 同时用手写的语法分析器（见ASTParser）和ANTLR解析pattern，两者得到的抽象语法树（或是否有语法错误）不一致时抛出异常
+     */
+    RegexAST parseValidated(const std::string &pattern);
 
-    void compileExpressionItem(regexParser::ExpressionItemContext *ei);
+    bool validate_with_antlr = false; // 为true时compile使用parseValidated，否则只使用手写的语法分析器
+#endif
 
-    void compileSingle(regexParser::SingleContext *s);
+    /**
+     * 把compile的结果写成二进制格式（见ProgramFile），之后可以用deserialize或load代替compile，不需要再解析正则表达式和构造NFA
+     * 分组个数超过NFA状态个数时无法保存，抛出std::runtime_error
+     */
+    std::string serialize() const;
+
+    /**
+     * 把serialize的结果写入文件，失败时抛出std::system_error
+     */
+    void save(const std::string &path) const;
+
+    /**
+     * 读入serialize的结果，代替compile（同样只能调用一次）。格式、版本不正确或内容损坏时抛出std::runtime_error
+     */
+    void deserialize(const char *data, size_t size);
+
+    /**
+     * 用mmap映射save写入的文件并读入，代替compile。多个进程读入同一个文件时共享它的页
+     */
+    void load(const std::string &path);
 
     /**
      * 在给定的输入文本上，进行正则表达式匹配，返回匹配到的第一个结果。
@@ -67,7 +117,12 @@ public:
      * @param text 输入的文本
      * @return 如上所述
      */
-    std::vector<std::string> match(std::string text);
+    std::vector<std::string> match(std::string_view text) const;
+
+    /**
+     * 同match，使用调用者提供的scratch（不带scratch的各个匹配函数使用当前线程缓存的MatchScratch，见localScratch）
+     */
+    std::vector<std::string> match(std::string_view text, MatchScratch &scratch) const;
 
     /**
      * 在给定的输入文本上，进行正则表达式匹配，返回匹配到的**所有**结果。
@@ -76,7 +131,9 @@ public:
      * @param text 输入的文本
      * @return 如上所述
      */
-    std::vector<std::vector<std::string>> matchAll(std::string text);
+    std::vector<std::vector<std::string>> matchAll(std::string_view text) const;
+
+    std::vector<std::vector<std::string>> matchAll(std::string_view text, MatchScratch &scratch) const;
 
     /**
      * 在给定的输入文本上，进行基于正则表达式的替换，返回替换完成的结果。
@@ -85,7 +142,100 @@ public:
      * @param replacement 要将每一处正则表达式的匹配结果替换为什么内容
      * @return 替换后的文本
      */
-    std::string replaceAll(std::string text, std::string replacement);
+    std::string replaceAll(std::string_view text, const std::string &replacement) const;
+
+    std::string replaceAll(std::string_view text, const std::string &replacement, MatchScratch &scratch) const;
+
+    /**
+     * 同matchAll，文本较长时分块交给线程池并行查找（见searchAll），结果与单线程完全相同
+     * @param threads 分块的依据，文本最多分为threads*4块，为1时不分块；0或超过pool的线程数时取pool的线程数
+     * @param pool 执行查找和求捕获分组的线程池
+     */
+    std::vector<std::vector<std::string>> matchAll(std::string_view text, int threads,
+                                                   ThreadPool &pool = ThreadPool::global()) const;
+
+    /**
+     * 同replaceAll，文本较长时在线程池上并行查找和替换
+     */
+    std::string replaceAll(std::string_view text, const std::string &replacement, int threads,
+                           ThreadPool &pool = ThreadPool::global()) const;
+
+    /**
+     * 判断给定的文本中是否存在匹配。不需要捕获分组，因此优先使用位并行引擎或惰性DFA执行。
+     * @param text 输入的文本
+     * @return 是否存在匹配
+     */
+    bool test(std::string_view text) const;
+
+    bool test(std::string_view text, MatchScratch &scratch) const;
+
+    /**
+     * 对count个输入分别调用match，在线程池上并行执行（见ThreadPool）。每个线程使用自己缓存的MatchScratch，
+     * 除了结果本身以外，每个输入不再分配内存
+     * @param texts 输入，需在调用期间保持有效
+     * @return 第i个元素为match(texts[i])
+     */
+    std::vector<std::vector<std::string>> matchBatch(const std::string_view *texts, size_t count,
+                                                     ThreadPool &pool = ThreadPool::global()) const;
+
+    std::vector<std::vector<std::string>> matchBatch(const std::vector<std::string_view> &texts,
+                                                     ThreadPool &pool = ThreadPool::global()) const;
+
+    /**
+     * 对count个输入分别调用test，在线程池上并行执行
+     * @return 第i个元素非0表示texts[i]中存在匹配
+     */
+    std::vector<char> testBatch(const std::string_view *texts, size_t count, ThreadPool &pool = ThreadPool::global()) const;
+
+    std::vector<char> testBatch(const std::vector<std::string_view> &texts, ThreadPool &pool = ThreadPool::global()) const;
+
+    static const int BATCH_GRAIN = 64; // 批量匹配时每次取出的输入个数
+
+    /**
+     * 从start开始寻找下一个匹配，是match、matchAll、replaceAll共用的搜索循环
+     * 若找到的是紧接在上一个匹配之后的空匹配，则跳过它，从下一个位置继续寻找
+     * 先用正向、反向的惰性DFA确定匹配的范围，再在这个范围上求捕获分组：NFA为one-pass时使用OnePass，
+     * 否则范围较短、访问标记在预算之内时使用回溯引擎，再否则使用PikeVM。NFA带计数器时直接用PikeVM搜索
+     * @param scratch 可变状态，找到的匹配写入scratch.slots，格式见PikeVM::exec
+     * @param last_end 上一个匹配的结束位置，没有则为-1
+     * @param pending 不为空时，text只是到目前为止的输入（见StreamMatcher），只返回不受后面的输入影响的匹配。
+     *        返回false时*pending为之后的匹配最早可能的起点，在它之前的文本不会再用到（除了前一个字节，用于判断anchor）
+     * @return 是否找到
+     */
+    bool search(MatchScratch &scratch, std::string_view text, int start, int last_end, int *pending = nullptr) const;
+
+    /**
+     * 将slots转换为match函数返回值的格式
+     */
+    std::vector<std::string> groups(std::string_view text, const std::vector<int> &slots) const;
+
+    /**
+     * 当前线程缓存的、属于本对象的MatchScratch，没有则新建。每个线程按LRU缓存最近用过的scratch_pool个（见ScratchPool）。
+     * 返回的引用在本线程下一次为其他Regex调用localScratch（包括不带scratch的匹配函数）之后可能失效，不能跨过这样的调用保存
+     */
+    MatchScratch &localScratch() const;
+
+    /**
+     * scratch不是由本对象创建的时抛出std::invalid_argument
+     */
+    void checkScratch(const MatchScratch &scratch) const;
+
+    /**
+     * 估计本对象占用的内存字节数，包括NFA和各引擎的表，不包括MatchScratch（惰性DFA的缓存在其中，会随着匹配增长）
+     */
+    size_t byteSize() const;
+
+    // 每个线程最多缓存的MatchScratch的个数（RegexSet::Cache另有同样多个），轮流使用更多的正则表达式时才会重新创建。
+    // 每个MatchScratch中惰性DFA的缓存可能有几百KB，线程多时可以调小
+    inline static std::atomic<size_t> scratch_pool{256};
+
+    int max_states = NFABuilder::DEFAULT_MAX_STATES; // compile时NFA最多的状态数，超过时抛出std::runtime_error。需在compile之前设置
+
+    int unroll_limit = NFABuilder::DEFAULT_UNROLL_LIMIT; // {m,n}展开后超过这么多状态时改用计数器，见NFABuilder。需在compile之前设置
+
+    int parallel_chunk = 1 << 18; // 并行查找时每块的最小字节数，文本不足两块时只用一个线程
+
+    long long bitstate_budget = BitState::DEFAULT_MAX_BITS; // 回溯引擎的访问标记最多占用的位数，为0时总是使用PikeVM。需在第一次匹配之前设置
 
     // 目前仅支持一个默认无参构造函数，且不允许拷贝构造（因为类内有指针）。
     Regex() = default;
@@ -96,10 +246,80 @@ public:
     ~Regex();
 
 private:
+#ifdef REGEX_WITH_ANTLR
+    /**
+     * 释放ANTLR语法分析树所使用的内存
+     */
+    void releaseParser();
+#endif
+
+    /**
+     * 由nfa、reverse_nfa和required生成预过滤和各个引擎，并分配编号
+     */
+    void buildEngines();
+
+    /**
+     * 并行求出text中的所有匹配（与matchAll的顺序、结果相同），各个匹配的slots依次排列在返回值中。
+     * 文本分为chunks块，每块由pool中的一个线程从块的开头以流式的方式（见search的pending参数）在到块尾为止的前缀上查找，
+     * 只保留起点在块内、不受块尾之后的文本影响的匹配。之后按顺序合并：当前的搜索状态落在某块已经扫描过的范围内时，
+     * 从那里起直接采用该块的结果；否则（前一个匹配越过了块的边界并在块中某个匹配的中间结束，或块尾有尚未确定的匹配）
+     * 从当前位置单独查找下一个匹配，所用的前缀每次加倍，直到重新对齐
+     */
+    std::vector<int> searchAll(std::string_view text, int chunks, ThreadPool &pool) const;
+
+    friend class MatchScratch;
+    friend class RegexSet;
+
+    uint64_t id = 0; // compile时分配的编号，各个对象互不相同，用于区分MatchScratch属于哪个对象
+    LiteralInfo required; // 必需字面量，compile时分析得到，serialize时与NFA一起保存
+    Prefilter prefilter; // 匹配起点的预过滤，compile时分析得到
+    std::unique_ptr<LazyDFA> dfa; // 用于不需要捕获分组的查询，以及求匹配的结束位置，compile时创建。NFA带计数器时为空
+    NFA reverse_nfa; // 反向的NFA，见NFA::reverse。NFA带计数器时只有一个状态，不使用
+    std::unique_ptr<LazyDFA> reverse_dfa; // 在reverse_nfa上构造，从匹配的结束位置往回求起点
+    std::unique_ptr<OnePass> onepass; // NFA为one-pass时，用它在匹配的范围上求捕获分组，否则为空
+    std::unique_ptr<Glushkov> bits; // 较小且不含anchor的正则表达式，判断是否存在匹配时使用位并行的引擎，否则为空
+
+#ifdef REGEX_WITH_ANTLR
     antlr4::ANTLRInputStream *antlrInputStream = nullptr;
     regexLexer *antlrLexer = nullptr;
     antlr4::CommonTokenStream *antlrTokenStream = nullptr;
     regexParser *antlrParser = nullptr;
+#endif
+};
+
+/**
+ * 一次匹配所需的全部可变状态：PikeVM与回溯引擎的工作空间、正反两个惰性DFA的缓存、OnePass的捕获位置。
+ * 一个MatchScratch只能用于创建它的那个Regex，同一时刻只能被一个线程使用；可以在多次匹配之间复用，惰性DFA的缓存也随之保留。
+ */
+class MatchScratch {
+public:
+    /**
+     * @param re 已经compile过的Regex，需在MatchScratch使用期间保持存在
+     */
+    explicit MatchScratch(const Regex &re);
+
+    MatchScratch(const MatchScratch &) = delete;
+
+    /**
+     * 估计当前占用的字节数
+     */
+    size_t byteSize() const;
+
+    /**
+     * 上一次Regex::search找到的匹配，格式见PikeVM::exec
+     */
+    const std::vector<int> &found() const { return slots; }
+
+private:
+    friend class Regex;
+
+    uint64_t owner; // 所属Regex的编号
+    PikeVM vm;
+    BitState bt;
+    LazyDFA::Cache forward; // Regex::dfa的缓存
+    LazyDFA::Cache backward; // Regex::reverse_dfa的缓存
+    std::vector<int> cap; // OnePass::exec的临时空间
+    std::vector<int> slots; // search找到的匹配
 };
 
 #endif //CPP_REGEX_H
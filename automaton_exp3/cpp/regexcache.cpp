@@ -0,0 +1,89 @@
+#include "regexcache.h"
+#include <algorithm>
+
+RegexCache::RegexCache(size_t capacity) : shard_capacity(std::max<size_t>(1, (capacity + SHARDS - 1) / SHARDS))
+{
+}
+
+RegexCache &RegexCache::global()
+{
+    static RegexCache cache;
+    return cache;
+}
+
+std::string RegexCache::key(const std::string &pattern, const std::string &flags)
+{
+    std::string k = pattern;
+    k.push_back('\0');
+    if(flags.find('m') != std::string::npos)
+        k.push_back('m');
+    if(flags.find('s') != std::string::npos)
+        k.push_back('s');
+    return k;
+}
+
+/**
+ * 命中时把条目移到LRU链表的最前；未命中时在锁外compile，插入前再查一次，期间已被其他线程插入时使用已有的
+*/
+RegexHandle RegexCache::get(const std::string &pattern, const std::string &flags)
+{
+    std::string k = key(pattern, flags);
+    Shard &shard = shards[std::hash<std::string>()(k) % SHARDS];
+    {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        auto it = shard.index.find(k);
+        if(it != shard.index.end())
+        {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            hits++;
+            return it->second->second;
+        }
+    }
+
+    misses++;
+    std::shared_ptr<Regex> re = std::make_shared<Regex>();
+    re->compile(pattern, flags);
+
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto it = shard.index.find(k);
+    if(it != shard.index.end())
+    {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return it->second->second;
+    }
+    shard.lru.emplace_front(k, std::move(re));
+    shard.index[k] = shard.lru.begin();
+    while(shard.lru.size() > shard_capacity)
+    {
+        shard.index.erase(shard.lru.back().first);
+        shard.lru.pop_back();
+        evictions++;
+    }
+    return shard.lru.front().second;
+}
+
+void RegexCache::clear()
+{
+    for(Shard &shard: shards)
+    {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        shard.index.clear();
+        shard.lru.clear();
+    }
+}
+
+size_t RegexCache::size() const
+{
+    size_t n = 0;
+    for(const Shard &shard: shards)
+    {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        n += shard.lru.size();
+    }
+    return n;
+}
+
+RegexCache::Stats RegexCache::stats() const
+{
+    return {hits.load(), misses.load(), evictions.load()};
+}
@@ -0,0 +1,79 @@
+#ifndef CPP_REGEXCACHE_H
+#define CPP_REGEXCACHE_H
+
+#include "regex.h"
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+/**
+ * compile好的Regex只读，可以被多个线程共享（见MatchScratch），用shared_ptr<const Regex>作为句柄，复制句柄的代价只是一次引用计数。
+ */
+typedef std::shared_ptr<const Regex> RegexHandle;
+
+/**
+ * 按(pattern, flags)缓存compile结果的LRU缓存。同一个pattern只compile一次，之后的get只是一次哈希表查找。
+ * 分为SHARDS个分片，按键的哈希值选择分片，每个分片有自己的锁和LRU链表，不同分片上的get互不阻塞。
+ * compile在锁外进行：两个线程同时未命中同一个键时可能各compile一次，先插入的被保留，另一个被丢弃。
+ * 被淘汰的Regex在所有句柄释放之后才析构，淘汰不影响正在使用它的线程。
+ */
+class RegexCache {
+public:
+    static const int SHARDS = 16;
+
+    /**
+     * @param capacity 缓存容量，平均分配到各个分片：每个分片最多缓存ceil(capacity/SHARDS)个（至少1个），满了就在本分片内淘汰。
+     *        因此总数最多为SHARDS*ceil(capacity/SHARDS)，可能略大于capacity；键在分片间分布不均时，总数未达到capacity也可能发生淘汰
+     */
+    explicit RegexCache(size_t capacity = 4096);
+
+    RegexCache(const RegexCache &) = delete;
+
+    /**
+     * 进程范围内共享的缓存
+     */
+    static RegexCache &global();
+
+    /**
+     * 返回pattern与flags对应的Regex，不在缓存中时compile并加入缓存。pattern有语法错误时抛出compile的异常，不缓存
+     * @param flags 正则表达式的修饰符，只有m、s有意义，顺序和重复不影响结果
+     */
+    RegexHandle get(const std::string &pattern, const std::string &flags = "");
+
+    /**
+     * 清空缓存，计数不清零
+     */
+    void clear();
+
+    /**
+     * 当前缓存的Regex个数
+     */
+    size_t size() const;
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses; // 未命中的次数，即compile的次数
+        uint64_t evictions; // 因为分片已满而被淘汰的个数
+    };
+
+    Stats stats() const;
+
+private:
+    struct Shard {
+        mutable std::mutex lock;
+        std::list<std::pair<std::string, RegexHandle>> lru; // 最近使用的在最前
+        std::unordered_map<std::string, std::list<std::pair<std::string, RegexHandle>>::iterator> index;
+    };
+
+    /**
+     * 缓存的键。pattern不含'\0'，用它分隔pattern与规范化之后的修饰符
+     */
+    static std::string key(const std::string &pattern, const std::string &flags);
+
+    size_t shard_capacity; // 每个分片最多缓存的个数
+    Shard shards[SHARDS];
+    std::atomic<uint64_t> hits{0}, misses{0}, evictions{0};
+};
+
+#endif //CPP_REGEXCACHE_H
@@ -0,0 +1,301 @@
+#include "regexset.h"
+#include "scratchpool.h"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+/**
+ * 先逐个编译，再把各个NFA依次接在合并的NFA后面：状态编号、字节集合的下标加上偏移，
+ * 各自的初态保留（可能有转移回到初态），它的转移另外复制一份给合并的初态0。带计数器的NFA跳过
+*/
+void RegexSet::compile(const std::vector<std::string> &patterns, const std::string &flags)
+{
+    if(id != 0) throw std::runtime_error("此RegexSet对象已被调用过一次compile函数，不可以再次调用！");
+    for(const std::string &pattern: patterns)
+    {
+        regexes.emplace_back(new Regex());
+        regexes.back()->compile(pattern, flags);
+    }
+
+    nfa.flag_m = flags.find('m') != std::string::npos;
+    nfa.flag_s = flags.find('s') != std::string::npos;
+    nfa.addState();
+    owner.push_back(-1);
+    for(int i = 0; i < (int)regexes.size(); i++)
+    {
+        const NFA &sub = regexes[i]->nfa;
+        unmerged.push_back(!sub.counters.empty());
+        if(unmerged[i])
+            continue;
+        merged++;
+        int base = nfa.num_states, set_base = nfa.sets.size();
+        nfa.sets.insert(nfa.sets.end(), sub.sets.begin(), sub.sets.end());
+        for(int q = 0; q < sub.num_states; q++)
+        {
+            nfa.addState();
+            owner.push_back(i);
+            for(const Rule &r: sub.rules[q])
+            {
+                Rule t;
+                t.dst = r.dst + base;
+                t.type = r.type;
+                t.set = r.set < 0 ? -1 : r.set + set_base;
+                t.guard = r.guard;
+                nfa.rules[base + q].push_back(t);
+            }
+        }
+        nfa.rules[0].insert(nfa.rules[0].end(), nfa.rules[base].begin(), nfa.rules[base].end());
+        nfa.is_final.resize(nfa.num_states);
+        for(int q = 0; q < sub.num_states; q++)
+            nfa.is_final[base + q] = sub.is_final[q];
+    }
+    nfa.is_final.resize(nfa.num_states);
+    nfa.computeClasses();
+    stride = nfa.num_classes + 1;
+
+    for(const std::vector<Rule> &rules: nfa.rules)
+        for(const Rule &r: rules)
+        {
+            if(r.guard & (ANCHOR_WORD | ANCHOR_NOT_WORD))
+                need_word = true;
+            if(r.guard & ANCHOR_BEGIN)
+                need_begin = true;
+        }
+
+    // 每个匹配都包含它所属的正则表达式的某个必需字面量，因此只有合并的每个正则表达式都有必需字面量时，并集才是必需的
+    prefilter = Prefilter::analyze(nfa);
+    LiteralInfo required;
+    required.before = 0;
+    for(int i = 0; i < (int)regexes.size(); i++)
+    {
+        if(unmerged[i])
+            continue;
+        const LiteralInfo &info = regexes[i]->required;
+        if(info.strings.empty())
+        {
+            required.strings.clear();
+            break;
+        }
+        required.strings.insert(required.strings.end(), info.strings.begin(), info.strings.end());
+        required.before = required.before < 0 || info.before < 0 ? -1 : std::max(required.before, info.before);
+    }
+    std::sort(required.strings.begin(), required.strings.end());
+    required.strings.erase(std::unique(required.strings.begin(), required.strings.end()), required.strings.end());
+    prefilter.setRequired(required);
+
+    static std::atomic<uint64_t> next_id{1};
+    id = next_id++;
+}
+
+void RegexSet::resetCache(Cache &cache) const
+{
+    cache.states.clear();
+    cache.ids.clear();
+    cache.table.clear();
+    if((int)cache.mark.size() != nfa.num_states)
+    {
+        cache.mark.assign(nfa.num_states, 0);
+        cache.seen.assign(nfa.num_states, 0);
+    }
+}
+
+int RegexSet::addState(Cache &cache, const std::vector<int> &insts, const std::vector<int> &accepts, int flags) const
+{
+    if(!need_word)
+        flags &= ~FLAG_WORD;
+    if(!need_begin)
+        flags &= ~FLAG_BEGIN;
+
+    std::vector<int> key(insts);
+    key.push_back(-1);
+    key.insert(key.end(), accepts.begin(), accepts.end());
+    auto it = cache.ids.find(std::make_pair(flags, key));
+    if(it != cache.ids.end())
+        return it->second;
+
+    int s = cache.states.size();
+    cache.states.push_back(Cache::DState{insts, accepts, flags});
+    cache.ids[std::make_pair(flags, std::move(key))] = s;
+    cache.table.resize(cache.table.size() + stride, -1);
+    return s;
+}
+
+int RegexSet::startState(Cache &cache, std::string_view text, int start) const
+{
+    int flags = 0;
+    if(start > 0 && w(text[start-1]))
+        flags |= FLAG_WORD;
+    if(start == 0 || (nfa.flag_m && text[start-1] == '\n'))
+        flags |= FLAG_BEGIN;
+    return addState(cache, {}, {}, flags);
+}
+
+/**
+ * 与LazyDFA::transition相同，只是没有优先级：每个位置都开启新的起点（文本结尾除外），到达终态时记下它所属的正则表达式，
+ * 其他状态照常转移。新状态的NFA状态排序后作为键，顺序不同的同一组状态是同一个DFA状态
+*/
+int RegexSet::transition(Cache &cache, int s, int k) const
+{
+    int c = k == nfa.num_classes ? LazyDFA::END : nfa.class_rep[k];
+    std::vector<int> roots = cache.states[s].insts;
+    int flags = cache.states[s].flags;
+    if(c != LazyDFA::END)
+        roots.push_back(0);
+
+    bool begin = flags & FLAG_BEGIN;
+    bool prev_word = flags & FLAG_WORD;
+    int next = c == LazyDFA::END ? -1 : c;
+    std::vector<int> &stack = cache.stack, &mark = cache.mark, &seen = cache.seen;
+    int mark_gen = ++cache.mark_gen, seen_gen = ++cache.seen_gen;
+    std::vector<int> insts, accepts;
+
+    stack.assign(roots.begin(), roots.end());
+    while(!stack.empty())
+    {
+        int q = stack.back();
+        stack.pop_back();
+        if(mark[q] == mark_gen)
+            continue;
+        mark[q] = mark_gen;
+        if(nfa.is_final[q])
+        {
+            accepts.push_back(owner[q]);
+            continue;
+        }
+        for(const Rule &r: nfa.rules[q])
+        {
+            if(!guardHolds(r.guard, begin, prev_word, next, nfa.flag_m))
+                continue;
+            if(r.type == EPSILON)
+                stack.push_back(r.dst);
+            else if(c != LazyDFA::END && seen[r.dst] != seen_gen && nfa.match(r, (char)c))
+            {
+                seen[r.dst] = seen_gen;
+                insts.push_back(r.dst);
+            }
+        }
+    }
+    std::sort(insts.begin(), insts.end());
+    std::sort(accepts.begin(), accepts.end());
+    accepts.erase(std::unique(accepts.begin(), accepts.end()), accepts.end());
+
+    int new_flags = 0;
+    if(c != LazyDFA::END && w((char)c))
+        new_flags |= FLAG_WORD;
+    if(nfa.flag_m && c == '\n')
+        new_flags |= FLAG_BEGIN;
+
+    int t = addState(cache, insts, accepts, new_flags);
+    cache.table[s * stride + k] = t;
+    return t;
+}
+
+/**
+ * 每读入一个字节查一次表，进入的状态上带有的接受标记就是在读入该字节之前结束了匹配的正则表达式。
+ * 合并的正则表达式都已匹配时提前结束。缓存频繁清空时（与LazyDFA::step的判断相同）放弃DFA，
+ * 对尚未确定的正则表达式逐个调用Regex::test；不在合并的NFA中的正则表达式总是逐个调用
+*/
+std::vector<int> RegexSet::matches(std::string_view text, Cache &cache) const
+{
+    if(cache.owner != id)
+        throw std::invalid_argument("Cache不属于此RegexSet对象");
+    if(cache.mark.empty())
+        resetCache(cache);
+    cache.resets = 0;
+    cache.progress = 0;
+
+    int len = text.length(), remaining = merged;
+    std::vector<bool> matched(regexes.size(), false);
+    bool failed = false;
+    int s = startState(cache, text, 0);
+    Prefilter::Cache pf_cache;
+    for(int index = 0; index <= len && remaining > 0; index++)
+    {
+        if(cache.states[s].insts.empty())
+        {
+            int next = index < len ? prefilter.next(text, index, pf_cache) : -1;
+            if(next < 0)
+                break;
+            if(next > index)
+            {
+                index = next;
+                s = startState(cache, text, index);
+            }
+        }
+
+        int k = index < len ? nfa.classes[(unsigned char)text[index]] : nfa.num_classes;
+        int t = cache.table[s * stride + k];
+        if(t < 0)
+        {
+            if((int)cache.states.size() >= MAX_STATES)
+            {
+                if(cache.resets > 0 && cache.progress < 10LL * MAX_STATES)
+                {
+                    failed = true;
+                    break;
+                }
+                cache.resets++;
+                cache.progress = 0;
+
+                Cache::DState cur = cache.states[s];
+                resetCache(cache);
+                s = addState(cache, cur.insts, cur.accepts, cur.flags);
+            }
+            t = transition(cache, s, k);
+        }
+        cache.progress++;
+        s = t;
+
+        for(int p: cache.states[s].accepts)
+            if(!matched[p])
+            {
+                matched[p] = true;
+                remaining--;
+            }
+    }
+
+    std::vector<int> result;
+    for(int i = 0; i < (int)regexes.size(); i++)
+        if(matched[i] || ((failed || unmerged[i]) && regexes[i]->test(text)))
+            result.push_back(i);
+    return result;
+}
+
+std::vector<int> RegexSet::matches(std::string_view text) const
+{
+    return matches(text, localCache());
+}
+
+std::vector<RegexSet::Match> RegexSet::find(std::string_view text) const
+{
+    std::vector<Match> result;
+    for(int i: matches(text))
+    {
+        const Regex &re = *regexes[i];
+        MatchScratch &scratch = re.localScratch();
+        if(re.search(scratch, text, 0, -1))
+            result.push_back({i, scratch.found()[0], scratch.found()[1]});
+    }
+    return result;
+}
+
+RegexSet::Cache &RegexSet::localCache() const
+{
+    thread_local ScratchPool<Cache> pool;
+
+    if(id == 0)
+        throw std::runtime_error("此RegexSet对象尚未compile");
+    if(Cache *c = pool.find(id))
+        return *c;
+    return pool.insert(id, std::unique_ptr<Cache>(new Cache(*this)), Regex::scratch_pool);
+}
+
+size_t RegexSet::Cache::byteSize() const
+{
+    size_t size = sizeof(Cache);
+    size += states.capacity() * sizeof(DState) + table.capacity() * sizeof(int);
+    for(auto &st: states)
+        size += 2 * (st.insts.capacity() + st.accepts.capacity() + 1) * sizeof(int) + sizeof(*ids.begin()) + 4 * sizeof(void*);
+    size += (stack.capacity() + mark.capacity() + seen.capacity()) * sizeof(int);
+    return size;
+}
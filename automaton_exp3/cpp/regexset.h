@@ -0,0 +1,130 @@
+#ifndef CPP_REGEXSET_H
+#define CPP_REGEXSET_H
+
+#include <map>
+#include "regex.h"
+
+/**
+ * 一组正则表达式，对一段文本只扫描一遍，求出其中哪些能匹配。
+ * 各个正则表达式消去epsilon转移之后的NFA合并为一个NFA：新的初态0拥有各个初态的全部转移，各自的终态保留，
+ * 终态所属的正则表达式就是接受的标记。在合并的NFA上运行一个不区分优先级的惰性DFA：每个位置都开启新的起点，
+ * 到达终态时不丢弃其他状态，DFA状态记录进入它的转移上接受了哪些正则表达式。
+ * 每个正则表达式都有必需字面量时，它们的并是整个集合的必需字面量，交给预过滤（见Prefilter::setRequired）；
+ * 没有存活的NFA状态时跳到下一个可能的起点，不含任何必需字面量的文本一个字节也不用处理。
+ * 带计数器的正则表达式（见NFA::counters）不能转换为DFA，不参与合并，另外逐个调用Regex::test。
+ * compile之后只读，匹配函数都是const的，可变的部分在Cache中，多个线程可以共享同一个RegexSet。
+ */
+class RegexSet {
+public:
+    /**
+     * 找到的一个匹配
+     */
+    struct Match {
+        int pattern; // 正则表达式在compile的参数中的下标
+        int begin, end; // 匹配的范围[begin, end)
+    };
+
+    /**
+     * 扫描时按需构造的DFA状态和转移表。一个Cache只能用于构造它的那个RegexSet，同一时刻只能被一个线程使用
+     */
+    class Cache {
+    public:
+        /**
+         * @param set 已经compile过的RegexSet
+         */
+        explicit Cache(const RegexSet &set) : owner(set.id) {}
+
+        size_t byteSize() const;
+
+    private:
+        friend class RegexSet;
+
+        struct DState {
+            std::vector<int> insts; // 尚未转移的NFA状态，从小到大排列
+            std::vector<int> accepts; // 进入本状态的转移上接受的正则表达式
+            int flags;
+        };
+
+        uint64_t owner; // 所属RegexSet的编号
+        std::vector<DState> states;
+        std::map<std::pair<int, std::vector<int>>, int> ids; // (flags, insts + {-1} + accepts) -> 状态编号
+        std::vector<int> table; // table[s*stride+k]为状态s在等价类k上的转移，-1表示尚未计算
+
+        // transition中使用的临时空间
+        std::vector<int> stack;
+        std::vector<int> mark; // mark[q]==mark_gen表示q已在本次的闭包中
+        int mark_gen = 0;
+        std::vector<int> seen; // seen[q]==seen_gen表示q已在新状态的列表中
+        int seen_gen = 0;
+
+        // 同LazyDFA::Cache，缓存频繁清空时放弃DFA
+        int resets = 0;
+        long long progress = 0;
+    };
+
+    /**
+     * 编译一组正则表达式，只能调用一次。任何一个有语法错误时抛出它的异常
+     * @param flags 所有正则表达式共同的修饰符
+     */
+    void compile(const std::vector<std::string> &patterns, const std::string &flags = "");
+
+    /**
+     * 正则表达式的个数
+     */
+    int size() const { return regexes.size(); }
+
+    /**
+     * 能在text中找到匹配的正则表达式（从小到大的下标），结果与逐个调用Regex::test相同，但只扫描一遍文本
+     */
+    std::vector<int> matches(std::string_view text) const;
+
+    std::vector<int> matches(std::string_view text, Cache &cache) const;
+
+    /**
+     * 能匹配的每个正则表达式的第一个匹配（与Regex::match的结果相同），按下标排列。
+     * 先用matches求出哪些能匹配，再只对这些正则表达式求匹配的位置
+     */
+    std::vector<Match> find(std::string_view text) const;
+
+    /**
+     * 第i个正则表达式单独编译的结果
+     */
+    const Regex &regex(int i) const { return *regexes[i]; }
+
+    static const int MAX_STATES = 4096; // 缓存中最多保存的DFA状态数
+
+private:
+    enum {
+        FLAG_WORD = 1, // 前一个字符是单词字符
+        FLAG_BEGIN = 2, // 当前位置满足^
+    };
+
+    int addState(Cache &cache, const std::vector<int> &insts, const std::vector<int> &accepts, int flags) const;
+
+    int startState(Cache &cache, std::string_view text, int start) const;
+
+    /**
+     * 计算状态s在等价类k（k==num_classes表示END）上的转移
+     */
+    int transition(Cache &cache, int s, int k) const;
+
+    void resetCache(Cache &cache) const;
+
+    /**
+     * 当前线程缓存的Cache，见Regex::localScratch，返回的引用同样可能被本线程之后的调用淘汰
+     */
+    Cache &localCache() const;
+
+    uint64_t id = 0;
+    std::vector<std::unique_ptr<Regex>> regexes;
+    NFA nfa; // 合并的NFA
+    std::vector<int> owner; // owner[q]为状态q所属的正则表达式，初态0为-1
+    std::vector<bool> unmerged; // 带计数器、不在合并的NFA中的正则表达式
+    int merged = 0; // 合并的正则表达式个数
+    Prefilter prefilter;
+    bool need_word = false;
+    bool need_begin = false;
+    int stride = 0;
+};
+
+#endif //CPP_REGEXSET_H
@@ -0,0 +1,52 @@
+#ifndef CPP_SCRATCHPOOL_H
+#define CPP_SCRATCHPOOL_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+/**
+ * 按所属对象的编号缓存匹配状态（MatchScratch、RegexSet::Cache）的LRU表，每个线程一个（见Regex::localScratch）。
+ * 超过容量时淘汰最久没有用过的那个，轮流使用的对象不超过容量时不会再新建。
+ * 编号不会重复，已经析构的对象留下的条目不会被误用，只是逐渐被挤到末尾淘汰。
+ */
+template<class T>
+class ScratchPool {
+public:
+    /**
+     * 编号为id的条目，没有则返回nullptr。找到的条目移到最前
+     */
+    T *find(uint64_t id)
+    {
+        // 连续使用同一个对象是最常见的情况，不必查哈希表
+        if(!lru.empty() && lru.front().first == id)
+            return lru.front().second.get();
+        auto it = index.find(id);
+        if(it == index.end())
+            return nullptr;
+        lru.splice(lru.begin(), lru, it->second);
+        return lru.front().second.get();
+    }
+
+    /**
+     * 加入编号为id的条目（需不在表中），之后条目数超过capacity时淘汰最久没有用过的
+     */
+    T &insert(uint64_t id, std::unique_ptr<T> item, size_t capacity)
+    {
+        lru.emplace_front(id, std::move(item));
+        index[id] = lru.begin();
+        while(lru.size() > std::max<size_t>(capacity, 1))
+        {
+            index.erase(lru.back().first);
+            lru.pop_back();
+        }
+        return *lru.front().second;
+    }
+
+private:
+    std::list<std::pair<uint64_t, std::unique_ptr<T>>> lru; // 最近使用的在最前
+    std::unordered_map<uint64_t, typename std::list<std::pair<uint64_t, std::unique_ptr<T>>>::iterator> index;
+};
+
+#endif //CPP_SCRATCHPOOL_H
@@ -0,0 +1,56 @@
+#include "streammatcher.h"
+#include <algorithm>
+#include <stdexcept>
+
+void StreamMatcher::take(std::vector<Match> &out)
+{
+    const std::vector<int> &slots = scratch.found();
+    std::vector<std::string> groups = re.groups(buffer, slots);
+    out.push_back({base + slots[0], base + slots[1], std::move(groups)});
+    last_end = slots[1];
+    // 空匹配之后从下一个位置继续，同Regex::matchAll
+    pos = slots[1] > slots[0] ? slots[1] : slots[0] + 1;
+}
+
+/**
+ * 找出所有已经确定的匹配之后，pending之前的输入不会再用到，只留下它前面的一个字节
+*/
+std::vector<StreamMatcher::Match> StreamMatcher::feed(const char *data, size_t size)
+{
+    if(finished)
+        throw std::runtime_error("StreamMatcher已经结束，不能再传入输入");
+    buffer.append(data, size);
+    std::vector<Match> out;
+    if(buffer.size() < retry)
+        return out;
+
+    int pending;
+    while(re.search(scratch, buffer, pos, last_end, &pending))
+        take(out);
+    pos = std::max(pos, pending);
+    retry = buffer.size() + (buffer.size() - pos);
+
+    int drop = pos - 1;
+    if(drop > 0)
+    {
+        buffer.erase(0, drop);
+        base += drop;
+        pos -= drop;
+        last_end = last_end >= drop ? last_end - drop : -1;
+        retry -= drop;
+    }
+    return out;
+}
+
+std::vector<StreamMatcher::Match> StreamMatcher::finish()
+{
+    if(finished)
+        throw std::runtime_error("StreamMatcher已经结束，不能再传入输入");
+    finished = true;
+    std::vector<Match> out;
+    while(re.search(scratch, buffer, pos, last_end))
+        take(out);
+    buffer.clear();
+    buffer.shrink_to_fit();
+    return out;
+}
@@ -0,0 +1,58 @@
+#ifndef CPP_STREAMMATCHER_H
+#define CPP_STREAMMATCHER_H
+
+#include "regex.h"
+
+/**
+ * 流式匹配：输入分成任意大小的块依次传入，每个匹配一旦确定（后面的输入不会再改变它）就返回，
+ * 得到的匹配与对整个输入调用Regex::matchAll相同，位置是在整个输入中的位置。
+ * 只保留尚未确定的匹配可能用到的那一段输入（见Regex::search的pending参数），另加前一个字节作为anchor的上下文（\b、m修饰符下的^）；
+ * 匹配的长度有上限（Prefilter::max_len）时，保留的长度不超过这个上限，否则取决于最长的那个尚未确定的匹配（如 a.*b 在a之后一直没有b）。
+ * 每次都从尚未确定的位置开始重新扫描，这一段较长时，等新的输入至少和它一样长之后才再次扫描，总的扫描量是线性的。
+ */
+class StreamMatcher {
+public:
+    struct Match {
+        long long begin, end; // 匹配在整个输入中的范围[begin, end)
+        std::vector<std::string> groups; // 格式同Regex::match的返回值
+    };
+
+    /**
+     * @param re 已经compile过的Regex，需在StreamMatcher使用期间保持存在
+     */
+    explicit StreamMatcher(const Regex &re) : re(re), scratch(re) {}
+
+    /**
+     * 传入下一块输入，返回因此确定的匹配
+     */
+    std::vector<Match> feed(const char *data, size_t size);
+
+    std::vector<Match> feed(const std::string &chunk) { return feed(chunk.data(), chunk.size()); }
+
+    /**
+     * 输入结束，返回剩下的匹配。之后不能再调用feed
+     */
+    std::vector<Match> finish();
+
+    /**
+     * 当前保留的输入的字节数
+     */
+    size_t buffered() const { return buffer.size(); }
+
+private:
+    /**
+     * 把scratch中找到的匹配加入out，并移到它之后
+     */
+    void take(std::vector<Match> &out);
+
+    const Regex &re;
+    MatchScratch scratch;
+    std::string buffer; // 保留的输入
+    long long base = 0; // buffer[0]在整个输入中的位置
+    int pos = 0; // 下一次搜索的起点（buffer中的位置，下同）
+    int last_end = -1; // 上一个匹配的结束位置
+    size_t retry = 0; // buffer至少这么长时才再次扫描
+    bool finished = false;
+};
+
+#endif //CPP_STREAMMATCHER_H
@@ -0,0 +1,33 @@
+#ifndef CPP_CHECK_H
+#define CPP_CHECK_H
+
+#include <cstdio>
+#include <stdexcept>
+
+/**
+ * 测试程序共用的检查。CHECK失败时打印位置并计数，不中止，main最后用failures决定返回值
+ */
+inline int failures = 0;
+
+#define CHECK(cond) do { \
+    if(!(cond)) { \
+        fprintf(stderr, "%s:%d: 检查失败：%s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while(0)
+
+/**
+ * f抛出std::runtime_error时返回true，正常返回时返回false，其他异常照常传出
+ */
+template<class F>
+bool throwsRuntimeError(F f)
+{
+    try {
+        f();
+    } catch(const std::runtime_error &) {
+        return true;
+    }
+    return false;
+}
+
+#endif //CPP_CHECK_H
@@ -0,0 +1,101 @@
+#ifndef CPP_RANDOMPATTERN_H
+#define CPP_RANDOMPATTERN_H
+
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * 差分测试用的随机正则表达式和文本。正则表达式由字面量、字符类、分组、anchor和各种量词随机组合而成，
+ * 文本只用TEXT中的几个字符，随机的文本中也经常出现匹配。种子固定，每次运行的用例相同
+ */
+class RandomPattern {
+public:
+    explicit RandomPattern(unsigned seed) : rng(seed) {}
+
+    /**
+     * [lo, hi]中的随机整数
+     */
+    int uniform(int lo, int hi) { return std::uniform_int_distribution<int>(lo, hi)(rng); }
+
+    template<class T>
+    const T &pick(const std::vector<T> &items) { return items[uniform(0, items.size() - 1)]; }
+
+    std::string pattern() { return alternation(1); }
+
+    std::string flags() { return pick(std::vector<std::string>{"", "m", "s", "ms"}); }
+
+    /**
+     * 长度为[0, max_len]的随机文本
+     */
+    std::string text(int max_len)
+    {
+        std::string s(uniform(0, max_len), ' ');
+        for(char &c: s)
+            c = TEXT[uniform(0, sizeof(TEXT) - 2)];
+        return s;
+    }
+
+    /**
+     * 约一半是piece的重复，其余是随机字符，长度约为count个piece。piece取能匹配的文本时，结果中有大量匹配
+     */
+    std::string repeat(const std::string &piece, int count)
+    {
+        std::string s;
+        for(int i = 0; i < count; i++)
+            s += uniform(0, 1) ? piece : text(1);
+        return s;
+    }
+
+    static constexpr char TEXT[] = "abc1 -\n";
+
+private:
+    std::string alternation(int depth)
+    {
+        std::string s = concatenation(depth);
+        for(int n = uniform(1, depth > 1 ? 2 : 3); n > 1; n--)
+            s += "|" + concatenation(depth);
+        return s;
+    }
+
+    std::string concatenation(int depth)
+    {
+        std::string s;
+        for(int n = uniform(1, 3); n > 0; n--)
+            s += item(depth);
+        return s;
+    }
+
+    std::string item(int depth)
+    {
+        static const std::vector<std::string> literals{"a", "b", "c", "1", " ", "-", ":", ","};
+        static const std::vector<std::string> classes{"\\d", "\\w", "\\s", "\\D", "\\W", "\\S", "."};
+        static const std::vector<std::string> groups{"[ab]", "[^a]", "[a-c]", "[\\d ]", "[^\\w]", "[b-c1]", "[.]", "[\\s\\d]"};
+        static const std::vector<std::string> anchors{"^", "$", "\\b", "\\B"};
+        static const std::vector<std::string> quantifiers{"*", "+", "?", "{2}", "{1,}", "{0,2}", "{1,3}", "{2,}"};
+
+        int r = uniform(0, 99);
+        if(r < 8)
+            return pick(anchors);
+        std::string s;
+        if(r < 22 && depth < 3)
+            s = (uniform(0, 9) < 3 ? "(?:" : "(") + alternation(depth + 1) + ")";
+        else if(r < 50)
+            s = pick(literals);
+        else if(r < 70)
+            s = pick(classes);
+        else
+            s = pick(groups);
+        if(uniform(0, 99) < 45)
+        {
+            s += pick(quantifiers);
+            if(uniform(0, 9) < 3)
+                s += "?";
+        }
+        return s;
+    }
+
+    std::mt19937 rng;
+};
+
+#endif //CPP_RANDOMPATTERN_H
@@ -0,0 +1,93 @@
+#include "check.h"
+#include "randompattern.h"
+#include "regexset.h"
+#include "streammatcher.h"
+
+/**
+ * 计数器（见NFABuilder::counted）的测试。unroll_limit为0时每个可以用计数器的{m,n}都用计数器，
+ * 与默认（小的{m,n}展开，走DFA等引擎）的差分测试覆盖match、matchAll、test、流式匹配、分块并行、保存后读入和RegexSet；
+ * 另有上界很大的{m,n}，展开时NFA的状态数与上界成正比，用计数器时与上界无关
+*/
+int main()
+{
+    RandomPattern random(14);
+    ThreadPool pool(4);
+    int counted = 0;
+    for(int i = 0; i < 2000; i++)
+    {
+        std::string pattern = random.pattern(), flags = random.flags();
+        Regex unrolled, regex;
+        regex.unroll_limit = 0;
+        try {
+            unrolled.compile(pattern, flags);
+            regex.compile(pattern, flags);
+        } catch(const std::runtime_error &) {
+            continue;
+        }
+        counted += !regex.nfa.counters.empty();
+
+        std::string text = random.repeat(random.text(8), random.uniform(0, 12));
+        std::vector<std::vector<std::string>> expected = unrolled.matchAll(text);
+        CHECK(regex.matchAll(text) == expected);
+        CHECK(regex.match(text) == unrolled.match(text));
+        CHECK(regex.test(text) == unrolled.test(text));
+        regex.parallel_chunk = random.uniform(1, 10);
+        CHECK(regex.matchAll(text, 4, pool) == expected);
+
+        StreamMatcher stream(regex);
+        std::vector<StreamMatcher::Match> found;
+        for(size_t pos = 0; pos < text.size(); )
+        {
+            size_t size = std::min<size_t>(random.uniform(1, 5), text.size() - pos);
+            std::vector<StreamMatcher::Match> m = stream.feed(text.data() + pos, size);
+            found.insert(found.end(), m.begin(), m.end());
+            pos += size;
+        }
+        std::vector<StreamMatcher::Match> m = stream.finish();
+        found.insert(found.end(), m.begin(), m.end());
+        CHECK(found.size() == expected.size());
+        for(size_t k = 0; k < std::min(found.size(), expected.size()); k++)
+            CHECK(found[k].groups == expected[k]);
+
+        if(regex.nfa.group_num <= regex.nfa.num_states)
+        {
+            std::string data = regex.serialize();
+            Regex loaded;
+            loaded.deserialize(data.data(), data.size());
+            CHECK(loaded.nfa.counters.size() == regex.nfa.counters.size());
+            CHECK(loaded.matchAll(text) == expected);
+        }
+    }
+    CHECK(counted > 500);
+
+    // 上界很大时状态数与上界无关，匹配结果与展开的相同
+    Regex word;
+    word.compile("\\w{1,30000}");
+    CHECK(word.nfa.num_states < 100);
+    CHECK(word.match(std::string(50000, 'x')) == std::vector<std::string>({std::string(30000, 'x')}));
+    Regex nested;
+    nested.compile("(a{1,100}){1,100}");
+    CHECK(nested.nfa.num_states < 1000);
+    CHECK(nested.match(std::string(20000, 'a')) == std::vector<std::string>({std::string(10000, 'a'), std::string(100, 'a')}));
+    Regex large;
+    large.compile("(?:a{1,1000}){1,1000}b");
+    CHECK(large.nfa.num_states < 10000);
+    CHECK(large.test(std::string(1500, 'a') + "b"));
+    CHECK(!large.test(std::string(1500, 'a') + "cb"));
+    Regex lower;
+    lower.compile("x(\\d{2,5000})y|(?:ab){1000,}c");
+    std::string ab;
+    for(int i = 0; i < 1500; i++)
+        ab += "ab";
+    CHECK(lower.matchAll("x1y x12y zz" + ab + "c") ==
+          std::vector<std::vector<std::string>>({{"x12y", "12"}, {ab + "c", ""}}));
+    CHECK(!lower.test(ab.substr(0, 1998) + "c"));
+
+    // RegexSet中带计数器的正则表达式不参与合并，逐个匹配
+    RegexSet set;
+    set.compile({"a{2000}", "b+", "(?:ab){1000,}c"});
+    CHECK(set.matches(std::string(2000, 'a')) == std::vector<int>({0}));
+    CHECK(set.matches(std::string(1999, 'a') + "b") == std::vector<int>({1}));
+    CHECK(set.matches(ab + "c") == std::vector<int>({1, 2}));
+    return failures == 0 ? 0 : 1;
+}
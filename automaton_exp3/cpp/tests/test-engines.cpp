@@ -0,0 +1,66 @@
+#include "check.h"
+#include "randompattern.h"
+#include "regex.h"
+
+/**
+ * 各个引擎之间的差分测试，以PikeVM为准：从文本的每个位置开始搜索时，
+ * BitState的结果（包括捕获分组）与它相同，正向惰性DFA求出的结束位置、反向惰性DFA从结束位置求出的起点与它的范围相同，
+ * 在这个范围上OnePass和限定范围的PikeVM、BitState求出的捕获分组也相同，这正是Regex::search分三步求匹配的方式。
+ * 惰性DFA另用一个很小的缓存，覆盖缓存清空和失效（FAILED）的情况
+*/
+int main()
+{
+    RandomPattern random(12);
+    int onepass_count = 0;
+    for(int i = 0; i < 2000; i++)
+    {
+        Regex regex;
+        try {
+            regex.compile(random.pattern(), random.flags());
+        } catch(const std::runtime_error &) {
+            continue;
+        }
+        const NFA &nfa = regex.nfa;
+        NFA reverse_nfa = nfa.reverse();
+        Prefilter prefilter = Prefilter::analyze(nfa);
+        PikeVM vm(nfa), filtered_vm(nfa, &prefilter);
+        BitState bt(nfa, 1LL << 30);
+        LazyDFA dfa(nfa), small_dfa(nfa, 8, &prefilter), reverse_dfa(reverse_nfa, 4096, nullptr, true);
+        LazyDFA::Cache cache, small_cache, reverse_cache;
+        std::unique_ptr<OnePass> onepass(OnePass::eligible(nfa) ? new OnePass(nfa) : nullptr);
+        std::unique_ptr<Glushkov> bits(Glushkov::eligible(nfa) ? new Glushkov(nfa) : nullptr);
+        onepass_count += onepass != nullptr;
+
+        std::string text = random.repeat(random.text(6), random.uniform(0, 8));
+        for(int start = 0; start < (int)text.size(); start++)
+        {
+            std::vector<int> expected, slots, cap;
+            bool found = vm.exec(text, start, expected);
+            CHECK(filtered_vm.exec(text, start, slots) == found);
+            if(found)
+                CHECK(slots == expected);
+            CHECK(bt.exec(text, start, slots) == found);
+            if(found)
+                CHECK(slots == expected);
+
+            int end = dfa.searchEnd(text, start, cache);
+            CHECK(end == (found ? expected[1] : -1));
+            int small_end = small_dfa.searchEnd(text, start, small_cache);
+            CHECK(small_end == LazyDFA::FAILED || small_end == end);
+            int earliest = dfa.searchEnd(text, start, cache, true);
+            CHECK((earliest >= 0) == found);
+            if(bits)
+                CHECK((bits->searchEarliest(text, start) >= 0) == found);
+            if(!found)
+                continue;
+
+            CHECK(reverse_dfa.searchStart(text, expected[1], start, reverse_cache) == expected[0]);
+            CHECK(vm.exec(text, expected[0], slots, expected[1]) && slots == expected);
+            CHECK(bt.exec(text, expected[0], slots, expected[1]) && slots == expected);
+            if(onepass)
+                CHECK(onepass->exec(text, expected[0], slots, expected[1], cap) && slots == expected);
+        }
+    }
+    CHECK(onepass_count > 100);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+#include "check.h"
+#include "mappedfile.h"
+#include "utils.h"
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * 与fopen后readAll的结果比较
+*/
+static std::string readFile(const std::string &path)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    std::string text = readAll(f);
+    fclose(f);
+    return text;
+}
+
+int main()
+{
+    // 普通文件
+    MappedFile self(__FILE__);
+    CHECK(self.size() > 0 && std::string(self.data(), self.size()) == readFile(__FILE__));
+
+    // /proc下的文件报告的大小为0
+    MappedFile proc("/proc/self/cmdline");
+    CHECK(proc.size() > 0);
+
+    // 管道，相当于./regex <(cat case.txt)
+    std::string text;
+    for(int i = 0; i < 100000; i++)
+        text += "line " + std::to_string(i) + "\n";
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    std::thread writer([&]() {
+        size_t written = 0;
+        while(written < text.size())
+        {
+            ssize_t n = write(fds[1], text.data() + written, text.size() - written);
+            if(n <= 0)
+                break;
+            written += n;
+        }
+        close(fds[1]);
+    });
+    MappedFile piped("/dev/fd/" + std::to_string(fds[0]));
+    writer.join();
+    close(fds[0]);
+    CHECK(std::string(piped.data(), piped.size()) == text);
+
+    bool thrown = false;
+    try {
+        MappedFile missing("/nonexistent/file");
+    } catch(const std::system_error &) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,28 @@
+#include "check.h"
+#include "randompattern.h"
+#include "regex.h"
+
+/**
+ * NFA::exec的访问标记超出预算时改用哈希集合，两种方式搜索的顺序相同，返回的路径应当完全一致
+*/
+int main()
+{
+    RandomPattern random(6);
+    for(int i = 0; i < 2000; i++)
+    {
+        Regex regex;
+        try {
+            regex.compile(random.pattern(), random.flags());
+        } catch(const std::runtime_error &) {
+            continue;
+        }
+        std::string text = random.repeat(random.text(6), random.uniform(0, 30));
+        NFA dense = regex.nfa, sparse = regex.nfa;
+        sparse.max_visited_bits = 0;
+        Path expected = dense.exec(text), actual = sparse.exec(text);
+        CHECK(actual.states == expected.states);
+        CHECK(actual.consumes == expected.consumes);
+        CHECK(sparse.visited.byteSize() == 0);
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+#include "check.h"
+#include "randompattern.h"
+#include "regex.h"
+#include <regex>
+
+/**
+ * 与std::regex（ECMAScript语法，回溯实现）的差分测试，检查match、matchAll、replaceAll的范围和捕获分组。
+ * RandomPattern生成的语法两者含义相同，只有s修饰符需要把.改写为[\s\S]。
+ * 能匹配空串的分组带有量词时跳过：回溯引擎在一次重复匹配了空串时回退，本库的引擎不区分，捕获分组（含anchor时连范围）可能不同；
+ * 而且std::regex在这样的嵌套量词上回溯的次数是指数级的
+*/
+
+/**
+ * 把pattern改写为ECMAScript的写法：s修饰符下字符组以外的.改为[\s\S]；strip_anchors时去掉^ $ \b \B
+*/
+static std::string rewrite(const std::string &pattern, bool flag_s, bool strip_anchors)
+{
+    std::string result;
+    bool in_class = false;
+    for(size_t i = 0; i < pattern.size(); i++)
+    {
+        char c = pattern[i];
+        if(c == '\\')
+        {
+            char next = pattern[++i];
+            if(!(strip_anchors && !in_class && (next == 'b' || next == 'B')))
+                result += {c, next};
+        }
+        else if(in_class)
+        {
+            in_class = c != ']';
+            result += c;
+        }
+        else if(c == '[')
+        {
+            in_class = true;
+            result += c;
+            if(pattern[i + 1] == '^')
+                result += pattern[++i];
+        }
+        else if(c == '.' && flag_s)
+            result += "[\\s\\S]";
+        else if(!(strip_anchors && (c == '^' || c == '$')))
+            result += c;
+    }
+    return result;
+}
+
+/**
+ * 是否有带量词、能匹配空串的分组。用std::regex判断去掉anchor后的内容能否匹配空串（anchor不消耗字符，去掉后只会多判为可空）
+*/
+static bool hasNullableLoop(const std::string &pattern)
+{
+    std::vector<size_t> open;
+    bool in_class = false;
+    for(size_t i = 0; i < pattern.size(); i++)
+    {
+        char c = pattern[i];
+        if(c == '\\')
+            i++;
+        else if(in_class)
+            in_class = c != ']';
+        else if(c == '[')
+        {
+            in_class = true;
+            if(pattern[i + 1] == '^')
+                i++;
+        }
+        else if(c == '(')
+            open.push_back(i);
+        else if(c == ')')
+        {
+            size_t begin = open.back() + 1;
+            open.pop_back();
+            if(i + 1 == pattern.size() || std::string("*+?{").find(pattern[i + 1]) == std::string::npos)
+                continue;
+            std::string body = pattern.substr(begin, i - begin);
+            if(body.compare(0, 2, "?:") == 0)
+                body = body.substr(2);
+            if(std::regex_match(std::string(), std::regex("(?:" + rewrite(body, false, true) + ")")))
+                return true;
+        }
+    }
+    return false;
+}
+
+struct Found {
+    int begin, end;
+    std::vector<std::string> groups; // 同Regex::match的返回值
+};
+
+/**
+ * 按Regex::matchAll的规则用std::regex找出所有匹配：起点不在文本末尾，紧接在上一个匹配之后的空匹配跳过
+*/
+static std::vector<Found> oracleAll(const std::regex &re, const std::string &text)
+{
+    std::vector<Found> result;
+    int p = 0, last_end = -1, len = text.size();
+    while(p < len)
+    {
+        std::smatch m;
+        auto flags = p > 0 ? std::regex_constants::match_prev_avail : std::regex_constants::match_default;
+        if(!std::regex_search(text.begin() + p, text.end(), m, re, flags))
+            break;
+        int begin = p + m.position(0), end = begin + m.length(0);
+        if(begin >= len)
+            break;
+        if(begin == end && begin == last_end)
+        {
+            p = begin + 1;
+            continue;
+        }
+        Found found{begin, end, {}};
+        for(size_t i = 0; i < m.size(); i++)
+            found.groups.push_back(m[i].matched ? m[i].str() : "");
+        result.push_back(found);
+        last_end = end;
+        p = end > begin ? end : begin + 1;
+    }
+    return result;
+}
+
+/**
+ * 对照replaceAll("<$1|$0>")的结果，没有分组时$1替换为空
+*/
+static std::string oracleReplace(const std::string &text, const std::vector<Found> &all)
+{
+    std::string result;
+    int p = 0;
+    for(const Found &found: all)
+    {
+        result += text.substr(p, found.begin - p);
+        result += "<" + (found.groups.size() > 1 ? found.groups[1] : "") + "|" + found.groups[0] + ">";
+        p = found.end;
+    }
+    return result + text.substr(p);
+}
+
+int main()
+{
+    RandomPattern random(8);
+    int compared = 0;
+    for(int i = 0; i < 3000; i++)
+    {
+        std::string pattern = random.pattern(), flags = random.flags();
+        Regex regex;
+        try {
+            regex.compile(pattern, flags);
+        } catch(const std::runtime_error &) {
+            continue;
+        }
+        if(hasNullableLoop(pattern))
+            continue;
+        bool flag_m = flags.find('m') != std::string::npos, flag_s = flags.find('s') != std::string::npos;
+        std::regex re(rewrite(pattern, flag_s, false),
+                      flag_m ? std::regex::ECMAScript | std::regex::multiline : std::regex::ECMAScript);
+        compared++;
+
+        for(int j = 0; j < 3; j++)
+        {
+            std::string text = random.repeat(random.text(6), random.uniform(0, 8));
+            std::vector<Found> expected = oracleAll(re, text);
+            std::vector<std::vector<std::string>> all = regex.matchAll(text), expected_all;
+            for(const Found &found: expected)
+                expected_all.push_back(found.groups);
+            CHECK(all == expected_all);
+            CHECK(regex.match(text) == (expected.empty() ? std::vector<std::string>() : expected[0].groups));
+            CHECK(regex.replaceAll(text, "<$1|$0>") == oracleReplace(text, expected));
+        }
+    }
+    CHECK(compared > 2000);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,28 @@
+#include "check.h"
+#include "randompattern.h"
+#include "regex.h"
+
+/**
+ * 分块并行的matchAll、replaceAll与单线程的差分测试。块取得很小，使匹配经常跨过块的边界。
+ * 使用自己的线程池，在只有一个硬件线程的机器上也会真正并行
+*/
+int main()
+{
+    RandomPattern random(4);
+    ThreadPool pool(4);
+    for(int i = 0; i < 2000; i++)
+    {
+        Regex regex;
+        try {
+            regex.compile(random.pattern(), random.flags());
+        } catch(const std::runtime_error &) {
+            continue;
+        }
+        std::string text = random.repeat(random.text(14), random.uniform(0, 300));
+        regex.parallel_chunk = random.uniform(1, 40);
+        int threads = random.uniform(1, 4);
+        CHECK(regex.matchAll(text, threads, pool) == regex.matchAll(text));
+        CHECK(regex.replaceAll(text, "<$1|$0>", threads, pool) == regex.replaceAll(text, "<$1|$0>"));
+    }
+    return failures == 0 ? 0 : 1;
+}
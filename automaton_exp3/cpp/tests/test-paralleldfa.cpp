@@ -0,0 +1,35 @@
+#include "check.h"
+#include "randompattern.h"
+#include "regex.h"
+#include "dfa.h"
+
+/**
+ * 分块并行的DFA::exec与单线程的差分测试。块取得很小，从所有状态出发的模拟与合并经常跨过块的边界。
+ * 使用自己的线程池，在只有一个硬件线程的机器上也会真正并行
+*/
+int main()
+{
+    RandomPattern random(5);
+    ThreadPool pool(4);
+    for(int i = 0; i < 2000; i++)
+    {
+        std::string piece = random.text(14);
+        // 多数文本由能被接受的串重复而成，否则几乎总是很快进入dead
+        std::string pattern = random.pattern();
+        if(random.uniform(0, 1))
+            pattern = "(" + pattern + ")*";
+        Regex regex;
+        DFA dfa;
+        try {
+            regex.compile(pattern, random.flags());
+            dfa = DFA::from_nfa(regex.nfa);
+        } catch(const std::runtime_error &) {
+            continue;
+        }
+        dfa.minimize();
+        dfa.parallel_chunk = random.uniform(1, 30);
+        std::string text = random.repeat(piece, random.uniform(0, 300));
+        CHECK(dfa.exec(text, random.uniform(1, 4), pool) == dfa.exec(text));
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,47 @@
+#include "check.h"
+#include "randompattern.h"
+#include "regex.h"
+#include <cstring>
+
+/**
+ * 手写的语法分析器与ANTLR的差分测试：parseValidated在两者的抽象语法树或是否报错不一致时抛出异常，
+ * 两者都报告语法错误时抛出的是手写的语法分析器的错误
+*/
+static bool agrees(const std::string &pattern, const std::string &flags)
+{
+    Regex regex;
+    regex.nfa.flag_s = flags.find('s') != std::string::npos;
+    try {
+        regex.parseValidated(pattern);
+    } catch(const std::runtime_error &e) {
+        if(strstr(e.what(), "手写的语法分析器") == e.what())
+        {
+            fprintf(stderr, "%s /%s/: %s\n", pattern.c_str(), flags.c_str(), e.what());
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    RandomPattern random(1);
+    const std::string SYNTAX = "()[]{}|*+?\\^$-,:.dwsbB0123456789";
+    for(int i = 0; i < 2000; i++)
+    {
+        std::string pattern = random.pattern(), flags = random.flags();
+        CHECK(agrees(pattern, flags));
+
+        // 随机插入、删除或替换一个字符，多数会得到有语法错误的正则表达式
+        int pos = random.uniform(0, pattern.size() - 1);
+        char c = SYNTAX[random.uniform(0, SYNTAX.size() - 1)];
+        switch(random.uniform(0, 2))
+        {
+            case 0: pattern.insert(pattern.begin() + pos, c); break;
+            case 1: pattern.erase(pos, 1); break;
+            default: pattern[pos] = c; break;
+        }
+        CHECK(agrees(pattern, flags));
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+#include "check.h"
+#include "regex.h"
+#include "programfile.h"
+#include <functional>
+
+/**
+ * 读入pattern编译后serialize的结果，用modify改动读到的NFA后重新写出，得到内容损坏但校验和正确的文件
+*/
+static std::string craft(const std::string &pattern, const std::function<void(NFA &, NFA &)> &modify)
+{
+    Regex regex;
+    regex.compile(pattern);
+    std::string data = regex.serialize();
+    NFA nfa, reverse_nfa;
+    LiteralInfo required;
+    ProgramFile::read(data.data(), data.size(), nfa, reverse_nfa, required);
+    modify(nfa, reverse_nfa);
+    return ProgramFile::write(nfa, reverse_nfa, required);
+}
+
+static bool rejects(const std::string &data)
+{
+    return throwsRuntimeError([&]() {
+        Regex regex;
+        regex.deserialize(data.data(), data.size());
+    });
+}
+
+int main()
+{
+    // 不改动时可以读入，匹配结果与compile相同
+    std::string good = craft("(a)(b)", [](NFA &, NFA &) {});
+    Regex loaded;
+    loaded.deserialize(good.data(), good.size());
+    CHECK(loaded.match("xab") == std::vector<std::string>({"ab", "a", "b"}));
+
+    // 正向NFA没有saves时，捕获引擎会越界访问
+    CHECK(rejects(craft("(a)(b)", [](NFA &nfa, NFA &) { nfa.saves.clear(); })));
+    CHECK(rejects(craft("(a)(b)", [](NFA &nfa, NFA &) { nfa.saves.pop_back(); })));
+    CHECK(rejects(craft("a", [](NFA &nfa, NFA &) { nfa.saves.clear(); })));
+    // 反向NFA不带saves和分组
+    CHECK(rejects(craft("(a)(b)", [](NFA &, NFA &reverse_nfa) {
+        reverse_nfa.saves.assign(reverse_nfa.num_states, std::vector<int>());
+    })));
+    CHECK(rejects(craft("(a)(b)", [](NFA &, NFA &reverse_nfa) { reverse_nfa.group.push_back({{0, 1}}); })));
+    // 分组个数不一致
+    CHECK(rejects(craft("(a)(b)", [](NFA &nfa, NFA &) { nfa.group_num = 1; nfa.group.pop_back(); })));
+    CHECK(rejects(craft("(a)(b)", [](NFA &nfa, NFA &) { nfa.group.push_back({{0, 1}}); })));
+    CHECK(rejects(craft("(a)(b)", [](NFA &, NFA &reverse_nfa) { reverse_nfa.group_num = 0; })));
+    // 分组个数过大，捕获引擎会分配巨大的slot数组
+    CHECK(rejects(craft("(a)(b)", [](NFA &nfa, NFA &reverse_nfa) {
+        nfa.group_num = reverse_nfa.group_num = 1 << 28;
+    })));
+    CHECK(rejects(craft("(a)(b)", [](NFA &nfa, NFA &reverse_nfa) {
+        nfa.group_num = reverse_nfa.group_num = nfa.num_states + 1;
+    })));
+
+    // 计数器：保存后读入的结果相同；计数器操作、范围越界，反向NFA带计数器
+    std::string counted = craft("(a{5000})b", [](NFA &, NFA &) {});
+    Regex counted_loaded;
+    counted_loaded.deserialize(counted.data(), counted.size());
+    CHECK(counted_loaded.nfa.counters.size() == 1);
+    CHECK(counted_loaded.test(std::string(5000, 'a') + "b") && !counted_loaded.test(std::string(4999, 'a') + "b"));
+    auto withOps = [](NFA &nfa, int op) {
+        for(std::vector<Rule> &rules: nfa.rules)
+            for(Rule &r: rules)
+                if(!r.ops.empty())
+                    r.ops[0] = op;
+    };
+    CHECK(rejects(craft("(a{5000})b", [&](NFA &nfa, NFA &) { withOps(nfa, 4); })));
+    CHECK(rejects(craft("(a{5000})b", [&](NFA &nfa, NFA &) { withOps(nfa, 3); })));
+    CHECK(rejects(craft("(a{5000})b", [](NFA &nfa, NFA &) { nfa.counters[0] = {10, 5}; })));
+    CHECK(rejects(craft("(a{5000})b", [](NFA &nfa, NFA &) { nfa.counters[0] = {-1, 5}; })));
+    CHECK(rejects(craft("(a{5000})b", [](NFA &nfa, NFA &reverse_nfa) { reverse_nfa.counters = nfa.counters; })));
+
+    // 没有分组、没有必需字面量等空数组的情况
+    Regex empty;
+    empty.compile("x*");
+    std::string data = empty.serialize();
+    Regex empty_loaded;
+    empty_loaded.deserialize(data.data(), data.size());
+    CHECK(empty_loaded.match("axx") == std::vector<std::string>({""}));
+    // 状态个数少于不出现在NFA中的分组，无法保存
+    Regex unused;
+    unused.compile("(a){0}(b){0}(c){0}(d){0}(e){0}(f){0}");
+    CHECK(throwsRuntimeError([&]() { unused.serialize(); }));
+
+    return failures == 0 ? 0 : 1;
+}
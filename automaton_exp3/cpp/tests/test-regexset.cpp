@@ -0,0 +1,47 @@
+#include "check.h"
+#include "randompattern.h"
+#include "regexset.h"
+
+/**
+ * RegexSet与逐个正则表达式调用test、match的差分测试
+*/
+int main()
+{
+    RandomPattern random(2);
+    for(int round = 0; round < 200; round++)
+    {
+        std::string flags = random.flags();
+        std::vector<std::string> patterns;
+        for(int n = random.uniform(1, 40); (int)patterns.size() < n; )
+        {
+            std::string pattern = random.pattern();
+            Regex regex;
+            try {
+                regex.compile(pattern, flags);
+            } catch(const std::runtime_error &) {
+                continue;
+            }
+            patterns.push_back(pattern);
+        }
+        RegexSet set;
+        set.compile(patterns, flags);
+        for(int t = 0; t < 20; t++)
+        {
+            std::string text = random.text(30);
+            std::vector<int> expected;
+            for(int i = 0; i < set.size(); i++)
+                if(set.regex(i).test(text))
+                    expected.push_back(i);
+            CHECK(set.matches(text) == expected);
+
+            std::vector<RegexSet::Match> found = set.find(text);
+            CHECK(found.size() == expected.size());
+            for(const RegexSet::Match &m: found)
+            {
+                std::vector<std::string> groups = set.regex(m.pattern).match(text);
+                CHECK(!groups.empty() && groups[0] == text.substr(m.begin, m.end - m.begin));
+            }
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,43 @@
+#include "check.h"
+#include "randompattern.h"
+#include "streammatcher.h"
+
+/**
+ * StreamMatcher与对整个输入调用matchAll的差分测试，输入按随机的大小分块传入
+*/
+int main()
+{
+    RandomPattern random(3);
+    for(int i = 0; i < 2000; i++)
+    {
+        Regex regex;
+        try {
+            regex.compile(random.pattern(), random.flags());
+        } catch(const std::runtime_error &) {
+            continue;
+        }
+        std::string text = random.repeat(random.text(14), random.uniform(1, 8));
+        std::vector<std::vector<std::string>> expected = regex.matchAll(text);
+
+        StreamMatcher stream(regex);
+        std::vector<StreamMatcher::Match> found;
+        int max_chunk = random.uniform(0, 1) ? 3 : 40;
+        for(size_t pos = 0; pos < text.size(); )
+        {
+            size_t size = std::min<size_t>(random.uniform(1, max_chunk), text.size() - pos);
+            std::vector<StreamMatcher::Match> m = stream.feed(text.data() + pos, size);
+            found.insert(found.end(), m.begin(), m.end());
+            pos += size;
+        }
+        std::vector<StreamMatcher::Match> m = stream.finish();
+        found.insert(found.end(), m.begin(), m.end());
+
+        CHECK(found.size() == expected.size());
+        for(size_t k = 0; k < std::min(found.size(), expected.size()); k++)
+        {
+            CHECK(found[k].groups == expected[k]);
+            CHECK(text.substr(found[k].begin, found[k].end - found[k].begin) == expected[k][0]);
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,159 @@
+#include "threadpool.h"
+#include <algorithm>
+
+/**
+ * 为true表示当前线程正在执行某个ThreadPool的任务，此时嵌套的parallelFor直接执行，避免等待自己
+*/
+static thread_local bool in_pool = false;
+
+ThreadPool::ThreadPool(int threads)
+{
+    if(threads <= 0)
+        threads = std::thread::hardware_concurrency();
+    threads = std::max(threads, 1);
+    ranges.reset(new Range[threads]);
+    for(int i = 1; i < threads; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(std::thread &t: workers)
+        t.join();
+}
+
+ThreadPool &ThreadPool::global()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::workerLoop(int id)
+{
+    in_pool = true;
+    uint64_t seen = 0;
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&]() { return stopping || generation != seen; });
+            if(stopping)
+                return;
+            seen = generation;
+        }
+        work(id);
+        std::lock_guard<std::mutex> guard(lock);
+        if(--busy == 0)
+            done.notify_all();
+    }
+}
+
+/**
+ * 区间在唤醒工作线程之前划分好，task等在锁内设置，工作线程被唤醒时都能看到。
+ * 每个工作线程都要结束本次的work（可能一个任务也没有取到）之后才返回，下一次parallelFor不会与它重叠
+*/
+void ThreadPool::parallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)> &f)
+{
+    if(n == 0)
+        return;
+    grain = std::max<size_t>(grain, 1);
+    if(in_pool || workers.empty() || n <= grain)
+    {
+        for(size_t begin = 0; begin < n; begin += grain)
+            f(begin, std::min(n, begin + grain));
+        return;
+    }
+
+    std::lock_guard<std::mutex> job(job_lock);
+    int p = size();
+    for(int i = 0; i < p; i++)
+    {
+        ranges[i].begin = n * i / p;
+        ranges[i].end = n * (i + 1) / p;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        task = &f;
+        this->grain = grain;
+        error = nullptr;
+        busy = workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    in_pool = true;
+    work(0);
+    in_pool = false;
+
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [&]() { return busy == 0; });
+    task = nullptr;
+    if(error)
+        std::rethrow_exception(error);
+}
+
+void ThreadPool::work(int id)
+{
+    size_t begin, end;
+    while(take(id, begin, end) || steal(id, begin, end))
+    {
+        try
+        {
+            (*task)(begin, end);
+        }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if(!error)
+                error = std::current_exception();
+        }
+    }
+}
+
+bool ThreadPool::take(int id, size_t &begin, size_t &end)
+{
+    Range &r = ranges[id];
+    std::lock_guard<std::mutex> guard(r.lock);
+    if(r.begin >= r.end)
+        return false;
+    begin = r.begin;
+    end = std::min(r.end, r.begin + grain);
+    r.begin = end;
+    return true;
+}
+
+/**
+ * 从下一个参与者开始依次查看，偷走第一个非空区间的后一半（剩余不超过grain时整个偷走）
+*/
+bool ThreadPool::steal(int id, size_t &begin, size_t &end)
+{
+    int p = size();
+    for(int k = 1; k < p; k++)
+    {
+        Range &victim = ranges[(id + k) % p];
+        size_t from, to;
+        {
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if(victim.begin >= victim.end)
+                continue;
+            size_t remaining = victim.end - victim.begin;
+            from = remaining <= grain ? victim.begin : victim.begin + remaining / 2;
+            to = victim.end;
+            victim.end = from;
+        }
+        // 第一段直接取走，其余放入自己的区间，可能又被其他参与者偷走
+        begin = from;
+        end = std::min(to, from + grain);
+        Range &own = ranges[id];
+        std::lock_guard<std::mutex> guard(own.lock);
+        own.begin = end;
+        own.end = to;
+        return true;
+    }
+    return false;
+}
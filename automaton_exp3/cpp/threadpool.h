@@ -0,0 +1,87 @@
+#ifndef CPP_THREADPOOL_H
+#define CPP_THREADPOOL_H
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * 常驻的工作线程池，用于把大量小任务（如Regex::matchBatch中的每个输入）分给多个线程，不必每次都创建线程。
+ * 线程常驻，线程局部的状态（如Regex::localScratch缓存的MatchScratch）在多次调用之间保留。
+ * 任务以下标区间的形式分配：开始时把区间平均分给每个参与者（工作线程和调用者），
+ * 各自从自己的区间前端每次取grain个执行；自己的做完之后从其他参与者的区间后端偷走剩余的一半（work stealing），
+ * 因此各个任务的耗时不均匀时也不会有线程空等。
+ */
+class ThreadPool {
+public:
+    /**
+     * @param threads 参与执行的线程数，包括调用者所在的线程，0表示硬件线程数
+     */
+    explicit ThreadPool(int threads = 0);
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ~ThreadPool();
+
+    /**
+     * 进程范围内共享的线程池，线程数为硬件线程数
+     */
+    static ThreadPool &global();
+
+    /**
+     * 参与执行的线程数，包括调用者
+     */
+    int size() const { return workers.size() + 1; }
+
+    /**
+     * 并行执行f(begin, end)，各次调用的[begin, end)互不相交，合起来是[0, n)，每段不超过grain。全部完成之后返回，
+     * 任务抛出的第一个异常在此时重新抛出。多个线程同时调用时依次执行；在任务中再调用（嵌套）时由当前线程直接执行
+     */
+    void parallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)> &f);
+
+private:
+    /**
+     * 一个参与者尚未执行的下标区间
+     */
+    struct Range {
+        std::mutex lock;
+        size_t begin = 0, end = 0;
+    };
+
+    void workerLoop(int id);
+
+    /**
+     * 参与者id不断取出任务执行，直到所有区间都为空
+     */
+    void work(int id);
+
+    /**
+     * 从自己的区间前端取出至多grain个下标
+     */
+    bool take(int id, size_t &begin, size_t &end);
+
+    /**
+     * 从其他参与者的区间后端偷走剩余的一半，取出其中的第一段，其余放入自己的区间。所有区间都为空时返回false
+     */
+    bool steal(int id, size_t &begin, size_t &end);
+
+    std::vector<std::thread> workers;
+    std::unique_ptr<Range[]> ranges; // 每个参与者一个，调用者为0，工作线程i为i+1
+
+    std::mutex job_lock; // 同一时刻只执行一个parallelFor
+    std::mutex lock; // 保护以下成员
+    std::condition_variable wake; // 通知工作线程有新的任务或要退出
+    std::condition_variable done; // 通知调用者工作线程都已结束
+    uint64_t generation = 0; // 每次parallelFor加1
+    int busy = 0; // 尚未结束本次任务的工作线程数
+    bool stopping = false;
+    const std::function<void(size_t, size_t)> *task = nullptr;
+    size_t grain = 1;
+    std::exception_ptr error;
+};
+
+#endif //CPP_THREADPOOL_H
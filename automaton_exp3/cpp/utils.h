@@ -2,6 +2,10 @@
 #define CPP_UTILS_H
 
 #include <string>
+#include <string_view>
+#include <cstdio>
+#include <cerrno>
+#include <system_error>
 
 #if defined(_WIN32) || defined(__CYGWIN__)
 
@@ -17,6 +21,38 @@ inline std::string strip(const std::string &s) {
     return s.substr(start, end + 1 - start);
 }
 
+inline std::string_view strip(std::string_view s) {
+    auto start = s.find_first_not_of(' ');
+    auto end = s.find_last_not_of(' ');
+    if (start == std::string_view::npos || end == std::string_view::npos) return {};
+    return s.substr(start, end + 1 - start);
+}
+
+/**
+ * 与std::getline相同地从text的pos处取出一行（不含换行符），pos移到下一行的开头。没有更多的行时返回false
+ */
+inline bool nextLine(std::string_view text, size_t &pos, std::string_view &line) {
+    if (pos >= text.size()) return false;
+    size_t end = text.find('\n', pos);
+    if (end == std::string_view::npos) end = text.size();
+    line = text.substr(pos, end - pos);
+    pos = end + 1;
+    return true;
+}
+
+/**
+ * 读入f的全部内容（用于不能映射的stdin）
+ */
+inline std::string readAll(FILE *f) {
+    std::string text;
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        text.append(buf, n);
+    if (ferror(f)) throw std::system_error(errno, std::generic_category());
+    return text;
+}
+
 inline void setStdoutToBinary() {
 #ifdef _WIN32
     _setmode(_fileno(stdout), _O_BINARY);